@@ -0,0 +1,78 @@
+// Fuzz target of the BMP reader: read_bmp_header and read_bmp_row are run on
+// any bytes. Built with clang it is a libFuzzer target; otherwise it replays
+// the files and directories it is given, and every truncation and every byte
+// flip of them, so it also runs in CI without libFuzzer.
+#define BMP_FUZZ
+#include "../main.c"
+
+#include <dirent.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    if (size == 0) return 0;
+    FILE * file = fmemopen((void *) data, size, "rb");
+    if (file == NULL) return 0;
+
+    struct BMP bmp;
+    if (read_bmp_header(file, &bmp) == 0) {
+        unsigned int width = (unsigned int) bmp.bitmapinfo.biWidth;
+        unsigned int height = (unsigned int) bmp.bitmapinfo.biHeight;
+        struct PIXEL * pixels = (struct PIXEL *) calloc(width, sizeof(struct PIXEL));
+        for (unsigned int i = 0; i < height; i++) {
+            if (read_bmp_row(file, &bmp, i, pixels) != 0) break;
+        }
+        free(pixels);
+    }
+    fclose(file);
+    return 0;
+}
+
+#ifndef BMP_LIBFUZZER
+// Runs a file, all its prefixes and the file with every byte inverted in turn.
+unsigned long replay_file(char * filename) {
+    FILE * file = fopen(filename, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open corpus file \"%s\"\n", filename);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    uint8_t * data = (uint8_t *) malloc(size > 0 ? (size_t) size : 1);
+    if (size <= 0 || fread(data, (size_t) size, 1, file) != 1) size = 0;
+    fclose(file);
+
+    unsigned long runs = 0;
+    for (long length = 1; length <= size; length++, runs++) LLVMFuzzerTestOneInput(data, (size_t) length);
+    for (long i = 0; i < size; i++, runs++) {
+        data[i] ^= 0xFF;
+        LLVMFuzzerTestOneInput(data, (size_t) size);
+        data[i] ^= 0xFF;
+    }
+    free(data);
+    return runs;
+}
+
+int main(int argc, char * argv[]) {
+    unsigned long runs = 0;
+    unsigned int files = 0;
+    for (int i = 1; i < argc; i++) {
+        DIR * dir = opendir(argv[i]);
+        if (dir == NULL) {
+            runs += replay_file(argv[i]);
+            files++;
+            continue;
+        }
+        struct dirent * entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", argv[i], entry->d_name);
+            runs += replay_file(path);
+            files++;
+        }
+        closedir(dir);
+    }
+    printf("fuzz_bmp: %lu inputs from %u corpus files\n", runs, files);
+    return files > 0 ? 0 : -1;
+}
+#endif
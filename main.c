@@ -1,8 +1,36 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef HAVE_NUMA
+#include <numa.h>
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
 
 typedef uint32_t DWORD;
 typedef uint16_t WORD;
@@ -24,14 +52,14 @@ struct BITMAPFILEHEADER {
 
 struct BITMAPINFO {
     DWORD biSize;
-    long biWidth;
-    long biHeight;
+    int32_t biWidth;
+    int32_t biHeight;
     WORD biPlanes;
     WORD biBitCount;
     DWORD biCompression;
     DWORD biSizeImage;
-    long biXPelsPerMeter;
-    long biYPelsPerMeter;
+    int32_t biXPelsPerMeter;
+    int32_t biYPelsPerMeter;
     DWORD biClrUsed;
     DWORD biClrImportant;
 };
@@ -64,10 +92,22 @@ int eq_pixel(struct PIXEL f, struct PIXEL s) {
     return 1;
 }
 
+// Where and how the rows of an input file are stored. Rows are addressed in
+// board order, bottom-up, also for a top-down file.
+struct BMP_LAYOUT {
+    long offset;
+    long stride;
+    int top_down;
+    unsigned int bits;
+    unsigned int colors;
+    struct PIXEL palette[256];
+};
+
 struct BMP {
     struct BITMAPFILEHEADER bitmapfileheader;
     struct BITMAPINFO bitmapinfo;
     struct PIXELSDATA pixelsdata;
+    struct BMP_LAYOUT layout;
 };
 
 void write_pixelsdata(struct BMP * image, FILE * file) {
@@ -93,32 +133,163 @@ struct BMP create_bmp(unsigned int width, unsigned int height, struct PIXEL * pi
     unsigned int size = start_of_pixels + 3 * height * width;
     struct BMP image = {
             {0x4D42, size, 0, 0, start_of_pixels},
-            {40, (long) width, (long) height, 1, 24, 0, size - start_of_pixels, 0, 0, 0, 0},
-            {pixels}
+            {40, (int32_t) width, (int32_t) height, 1, 24, 0, size - start_of_pixels, 0, 0, 0, 0},
+            {pixels},
+            {0}
     };
+    long mul = 3 * (long) width;
+    image.layout.offset = start_of_pixels;
+    image.layout.stride = mul % 4 != 0 ? mul + 4 - mul % 4 : mul;
+    image.layout.bits = 24;
     return image;
 }
 
-struct BMP read_bmp(FILE * file) {
-    struct BITMAPFILEHEADER * bitmapfileheader = (struct BITMAPFILEHEADER *) calloc(1, 14);
-    struct BITMAPINFO * bitmapinfo = (struct BITMAPINFO *) calloc(1, 40);
-    fread(bitmapfileheader, 14, 1, file);
-    fread(bitmapinfo, 40, 1, file);
+#define BI_RGB 0
+#define BI_BITFIELDS 3
 
-    long mul = 3 * bitmapinfo->biWidth;
-    long dif = 0;
-    if (mul % 4 != 0) dif = 4 - mul % 4;
+// Reads and checks the headers of a .bmp file. 24-bit and 32-bit files,
+// palettised files with 1, 4 or 8 bits per pixel and top-down files (with a
+// negative height) are supported. The pixel data must fit into the file, so
+// a truncated or corrupted header is rejected before anything is allocated.
+// Unless the file is a plain bottom-up 24-bit one, the headers are replaced
+// by those of the 24-bit image that is written as the output.
+int read_bmp_header(FILE * file, struct BMP * bmp) {
+    memset(bmp, 0, sizeof(struct BMP));
+    struct BITMAPFILEHEADER * header = &bmp->bitmapfileheader;
+    struct BITMAPINFO * info = &bmp->bitmapinfo;
+    struct BMP_LAYOUT * layout = &bmp->layout;
 
-    struct PIXEL * pixels = (struct PIXEL *) calloc(bitmapinfo->biHeight * bitmapinfo->biWidth, 3);
+    if (fseek(file, 0, SEEK_END) != 0) {
+        fprintf(stderr, "Error: Input file is not seekable\n");
+        return -1;
+    }
+    long file_size = ftell(file);
+    rewind(file);
+    if (file_size < 54 || fread(header, 14, 1, file) != 1 || fread(info, 40, 1, file) != 1) {
+        fprintf(stderr, "Error: Truncated BMP header\n");
+        return -1;
+    }
+    if (header->bfType != 0x4D42) {
+        fprintf(stderr, "Error: Not a BMP file\n");
+        return -1;
+    }
+    if (info->biSize < 40 || 14 + (long) info->biSize > file_size) {
+        fprintf(stderr, "Error: Unsupported BMP header size %u\n", info->biSize);
+        return -1;
+    }
+    if (info->biWidth <= 0 || info->biHeight == 0 || info->biHeight == INT32_MIN || info->biPlanes != 1) {
+        fprintf(stderr, "Error: Invalid BMP size %d x %d\n", info->biWidth, info->biHeight);
+        return -1;
+    }
 
-    for (long i = 0; i < bitmapinfo->biHeight; i++) {
-        fread(pixels + (bitmapinfo->biWidth * i), 3, bitmapinfo->biWidth, file);
-        fseek(file, dif, SEEK_CUR);
+    unsigned int bits = info->biBitCount;
+    if (bits != 1 && bits != 4 && bits != 8 && bits != 24 && bits != 32) {
+        fprintf(stderr, "Error: Unsupported BMP with %u bits per pixel\n", bits);
+        return -1;
+    }
+    if (info->biCompression != BI_RGB && !(bits == 32 && info->biCompression == BI_BITFIELDS)) {
+        fprintf(stderr, "Error: Unsupported compressed BMP (biCompression = %u)\n", info->biCompression);
+        return -1;
+    }
+    long tables = 14 + (long) info->biSize;
+    if (info->biCompression == BI_BITFIELDS) {
+        DWORD masks[3];
+        if (fseek(file, 14 + 40, SEEK_SET) != 0 || fread(masks, sizeof(masks), 1, file) != 1
+            || masks[0] != 0x00FF0000 || masks[1] != 0x0000FF00 || masks[2] != 0x000000FF) {
+            fprintf(stderr, "Error: Unsupported BMP channel masks\n");
+            return -1;
+        }
+        if (info->biSize == 40) tables += (long) sizeof(masks);
+    }
+
+    uint64_t width = (uint64_t) info->biWidth;
+    uint64_t height = info->biHeight < 0 ? (uint64_t) -(int64_t) info->biHeight : (uint64_t) info->biHeight;
+    uint64_t stride = (width * bits + 31) / 32 * 4;
+    if (header->bfOffBits < tables || (uint64_t) header->bfOffBits + stride * (height - 1) + (width * bits + 7) / 8
+                                      > (uint64_t) file_size) {
+        fprintf(stderr, "Error: Truncated BMP: %d x %d pixels of %u bits do not fit into %ld bytes\n",
+                info->biWidth, info->biHeight, bits, file_size);
+        return -1;
+    }
+
+    layout->offset = (long) header->bfOffBits;
+    layout->stride = (long) stride;
+    layout->top_down = info->biHeight < 0;
+    layout->bits = bits;
+    if (bits <= 8) {
+        layout->colors = info->biClrUsed != 0 ? info->biClrUsed : 1u << bits;
+        if (layout->colors > (1u << bits) || tables + 4 * (long) layout->colors > layout->offset) {
+            fprintf(stderr, "Error: Invalid BMP palette of %u colors\n", layout->colors);
+            return -1;
+        }
+        BYTE entry[4];
+        fseek(file, tables, SEEK_SET);
+        for (unsigned int i = 0; i < layout->colors; i++) {
+            if (fread(entry, 4, 1, file) != 1) {
+                fprintf(stderr, "Error: Truncated BMP palette\n");
+                return -1;
+            }
+            layout->palette[i] = pixel(entry[2], entry[1], entry[0]);
+        }
+    }
+
+    if (bits != 24 || layout->top_down || info->biSize != 40 || layout->offset != 54) {
+        struct BMP_LAYOUT source = *layout;
+        *bmp = create_bmp((unsigned int) width, (unsigned int) height, NULL);
+        bmp->layout = source;
+    }
+    return 0;
+}
+
+// Reads one row of an input file, in board order, as 24-bit pixels.
+int read_bmp_row(FILE * file, struct BMP * bmp, long row, struct PIXEL * pixels) {
+    struct BMP_LAYOUT * layout = &bmp->layout;
+    long width = bmp->bitmapinfo.biWidth;
+    long stored = layout->top_down ? bmp->bitmapinfo.biHeight - 1 - row : row;
+    if (fseek(file, layout->offset + stored * layout->stride, SEEK_SET) != 0) return -1;
+    if (layout->bits == 24) return fread(pixels, 3, (size_t) width, file) == (size_t) width ? 0 : -1;
+
+    BYTE buffer[4096];
+    long chunk = (long) sizeof(buffer) * 8 / layout->bits;
+    for (long done = 0; done < width; done += chunk) {
+        long count = width - done < chunk ? width - done : chunk;
+        size_t bytes = (size_t) (count * layout->bits + 7) / 8;
+        if (fread(buffer, 1, bytes, file) != bytes) return -1;
+        for (long j = 0; j < count; j++) {
+            if (layout->bits == 32) {
+                pixels[done + j] = pixel(buffer[4 * j + 2], buffer[4 * j + 1], buffer[4 * j]);
+                continue;
+            }
+            long bit = j * layout->bits;
+            unsigned int index = (buffer[bit / 8] >> (8 - layout->bits - bit % 8)) & ((1u << layout->bits) - 1);
+            if (index >= layout->colors) {
+                fprintf(stderr, "Error: BMP palette index %u out of range\n", index);
+                return -1;
+            }
+            pixels[done + j] = layout->palette[index];
+        }
     }
+    return 0;
+}
 
-    struct PIXELSDATA pixelsdata = {pixels};
-    struct BMP bmp = {*bitmapfileheader, *bitmapinfo, pixelsdata};
-    return bmp;
+int read_bmp(FILE * file, struct BMP * bmp) {
+    if (read_bmp_header(file, bmp) != 0) return -1;
+    size_t width = (size_t) bmp->bitmapinfo.biWidth;
+    size_t height = (size_t) bmp->bitmapinfo.biHeight;
+    struct PIXEL * pixels = (struct PIXEL *) calloc(width * height, 3);
+    if (pixels == NULL) {
+        fprintf(stderr, "Error: Not enough memory for a %zu x %zu image\n", width, height);
+        return -1;
+    }
+    for (size_t i = 0; i < height; i++) {
+        if (read_bmp_row(file, bmp, (long) i, pixels + width * i) != 0) {
+            fprintf(stderr, "Error: Cannot read row %zu of the BMP file\n", i);
+            free(pixels);
+            return -1;
+        }
+    }
+    bmp->pixelsdata.data = pixels;
+    return 0;
 }
 
 int ends_with_bmp(char * string) {
@@ -127,145 +298,4785 @@ int ends_with_bmp(char * string) {
     return(-1);
 }
 
-unsigned int get_index(unsigned int row, unsigned int column, struct BMP * bmp) {
-    return row * ((unsigned int) bmp->bitmapinfo.biWidth) + column;
+#define FORMAT_BMP 0
+#define FORMAT_RLE 1
+#define FORMAT_CELLS 2
+#define FORMAT_SNAPSHOT 3
+#define FORMAT_RANDOM 4
+
+int pattern_format(char * string) {
+    string = strrchr(string, '.');
+    if (string == NULL) return -1;
+    if (strcmp(string, ".bmp") == 0) return FORMAT_BMP;
+    if (strcmp(string, ".rle") == 0) return FORMAT_RLE;
+    if (strcmp(string, ".cells") == 0) return FORMAT_CELLS;
+    if (strcmp(string, ".snap") == 0) return FORMAT_SNAPSHOT;
+    return -1;
 }
 
-int main(int argc, char *argv[]) {
-    char * input_filename = "";
-    char * output_filename = "";
-    int max_iter = -1;
-    int dump_freq = 1;
+// A pattern is kept as runs of live cells. Pattern coordinates grow to the
+// right and down, like in a picture. A pattern is at most PATTERN_MAX cells
+// wide and high, the largest side of a .bmp image.
+#define PATTERN_MAX 0x7FFFFFFFu
 
-    char has_error = 0;
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "--input") == 0) {
-            input_filename = argv[++i];
-            if (ends_with_bmp(input_filename) != 0) {
-                fprintf(stderr, "Error: Invalid input file name \"%s\"\n", input_filename);
-                has_error = 1;
+struct RUN {
+    unsigned int x;
+    unsigned int y;
+    unsigned int length;
+};
+
+struct PATTERN {
+    unsigned int width;
+    unsigned int height;
+    unsigned int runs;
+    unsigned int capacity;
+    struct RUN * data;
+};
+
+void add_run(struct PATTERN * pattern, unsigned int x, unsigned int y, unsigned int length) {
+    if (pattern->runs == pattern->capacity) {
+        pattern->capacity = pattern->capacity == 0 ? 64 : 2 * pattern->capacity;
+        pattern->data = (struct RUN *) realloc(pattern->data, pattern->capacity * sizeof(struct RUN));
+    }
+    struct RUN run = {x, y, length};
+    pattern->data[pattern->runs++] = run;
+    if (x + length > pattern->width) pattern->width = x + length;
+    if (y + 1 > pattern->height) pattern->height = y + 1;
+}
+
+void skip_line(FILE * file) {
+    int c = fgetc(file);
+    while (c != EOF && c != '\n') c = fgetc(file);
+}
+
+// Reads a pattern in Golly RLE format. Only the B3/S23 rule is supported.
+int read_rle(FILE * file, struct PATTERN * pattern) {
+    char header[256];
+    int c = fgetc(file);
+    while (c == '#' || c == '\n' || c == '\r') {
+        if (c == '#') skip_line(file);
+        c = fgetc(file);
+    }
+    if (c == EOF) {
+        fprintf(stderr, "Error: Missing RLE header\n");
+        return -1;
+    }
+    ungetc(c, file);
+    if (fgets(header, sizeof(header), file) == NULL) return -1;
+
+    unsigned int width = 0;
+    unsigned int height = 0;
+    if (sscanf(header, " x = %u , y = %u", &width, &height) != 2) {
+        fprintf(stderr, "Error: Invalid RLE header \"%s\"\n", header);
+        return -1;
+    }
+    char * rule = strstr(header, "rule");
+    if (rule != NULL) {
+        rule = strchr(rule, '=');
+        char name[64] = "";
+        if (rule != NULL) sscanf(rule + 1, " %63[^ \r\n,]", name);
+        if (strcmp(name, "B3/S23") != 0 && strcmp(name, "b3/s23") != 0 && strcmp(name, "23/3") != 0) {
+            fprintf(stderr, "Error: Unsupported rule \"%s\"\n", name);
+            return -1;
+        }
+    }
+
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int count = 0;
+    while ((c = fgetc(file)) != EOF && c != '!') {
+        if (c >= '0' && c <= '9') {
+            if (count > (PATTERN_MAX - (unsigned int) (c - '0')) / 10) {
+                fprintf(stderr, "Error: RLE run count is larger than %u\n", PATTERN_MAX);
+                return -1;
             }
-        } else if (strcmp(argv[i], "--output") == 0) {
-            output_filename = argv[++i];
-            if (ends_with_bmp(output_filename) != 0) {
-                fprintf(stderr, "Error: Invalid output file name \"%s\"\n", output_filename);
-                has_error = 1;
+            count = count * 10 + (unsigned int) (c - '0');
+            continue;
+        }
+        if (c == '#') {
+            skip_line(file);
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+
+        if (count == 0) count = 1;
+        if ((c == '$' ? y : x) > PATTERN_MAX - count) {
+            fprintf(stderr, "Error: RLE pattern is larger than %u x %u cells\n", PATTERN_MAX, PATTERN_MAX);
+            return -1;
+        }
+        if (c == '$') {
+            y += count;
+            x = 0;
+        } else if (c == 'b' || c == '.') {
+            x += count;
+        } else if (c == 'o' || (c >= 'A' && c <= 'Z')) {
+            add_run(pattern, x, y, count);
+            x += count;
+        } else {
+            fprintf(stderr, "Error: Unexpected character '%c' in RLE pattern\n", c);
+            return -1;
+        }
+        count = 0;
+    }
+
+    if (width > pattern->width) pattern->width = width;
+    if (height > pattern->height) pattern->height = height;
+    return 0;
+}
+
+// Reads a pattern in plaintext format: '!' starts a comment line, '.' is a
+// dead cell and 'O' or '*' is a live cell.
+int read_cells(FILE * file, struct PATTERN * pattern) {
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int run = 0;
+    int c = fgetc(file);
+    while (c != EOF) {
+        if (x == 0 && c == '!') {
+            skip_line(file);
+            c = fgetc(file);
+            continue;
+        }
+        if (c == 'O' || c == '*') {
+            run++;
+        } else {
+            if (run > 0) add_run(pattern, x - run, y, run);
+            run = 0;
+            if (c == '\n') {
+                if (x > pattern->width) pattern->width = x;
+                y++;
+                x = 0;
+                c = fgetc(file);
+                continue;
             }
-        } else if (strcmp(argv[i], "--max_iter") == 0) {
-            char * max_iter_str = argv[++i];
-            max_iter = atoi(max_iter_str);
-            if (max_iter < 1) {
-                fprintf(stderr, "Error: --max-iter parameter value must be positive\n");
-                has_error = 1;
+            if (c == '\r') {
+                c = fgetc(file);
+                continue;
             }
-        } else if (strcmp(argv[i], "--dump_freq") == 0) {
-            char * dump_freq_str = argv[++i];
-            dump_freq = atoi(dump_freq_str);
-            if (dump_freq < 1) {
-                fprintf(stderr, "Error: --dump_freq parameter value must be positive\n");
-                has_error = 1;
+            if (c != '.') {
+                fprintf(stderr, "Error: Unexpected character '%c' in plaintext pattern\n", c);
+                return -1;
             }
         }
+        x++;
+        c = fgetc(file);
     }
+    if (run > 0) add_run(pattern, x - run, y, run);
+    if (x > pattern->width) pattern->width = x;
+    if (x > 0) y++;
+    if (y > pattern->height) pattern->height = y;
+    return 0;
+}
 
-    if (strcmp(input_filename, "") == 0) {
-        fprintf(stderr, "Error: Missing required parameter --input\n");
-        has_error = 1;
+int read_pattern(char * filename, int format, struct PATTERN * pattern) {
+    FILE * file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open input file \"%s\"\n", filename);
+        return -1;
     }
-    if (strcmp(output_filename, "") == 0) {
-        fprintf(stderr, "Error: Missing required parameter --output\n");
-        has_error = 1;
+    memset(pattern, 0, sizeof(struct PATTERN));
+    int result = format == FORMAT_RLE ? read_rle(file, pattern) : read_cells(file, pattern);
+    fclose(file);
+    return result;
+}
+
+// Where the first generation comes from: a .bmp image, a pattern placed at
+// an offset on a board of the given size, or a random soup.
+struct INPUT {
+    char * filename;
+    int format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int offset_x;
+    unsigned int offset_y;
+    struct PATTERN pattern;
+    double density;
+    uint64_t seed;
+};
+
+unsigned int get_index(unsigned int row, unsigned int column, struct BMP * bmp) {
+    return row * ((unsigned int) bmp->bitmapinfo.biWidth) + column;
+}
+
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+#define NUMA_FIRST_TOUCH 0
+#define NUMA_INTERLEAVE 1
+
+int numa_nodes() {
+#ifdef HAVE_NUMA
+    if (numa_available() >= 0) return numa_max_node() + 1;
+#endif
+    return 1;
+}
+
+int node_of_cpu(int cpu) {
+#ifdef HAVE_NUMA
+    if (cpu >= 0 && numa_available() >= 0) {
+        int node = numa_node_of_cpu(cpu);
+        if (node >= 0) return node;
     }
-    if (max_iter == -1) {
-        fprintf(stderr, "Error: Missing required parameter --max_iter\n");
-        has_error = 1;
+#else
+    (void) cpu;
+#endif
+    return 0;
+}
+
+// Board buffers are never written here: pages are placed by the first worker
+// that touches them, or interleaved across all nodes when libnuma is present.
+void * alloc_board(size_t size, int numa_policy) {
+#ifdef HAVE_NUMA
+    if (numa_policy == NUMA_INTERLEAVE && numa_nodes() > 1) {
+        return numa_alloc_interleaved(size);
     }
+#else
+    (void) numa_policy;
+#endif
+    void * board = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (board == MAP_FAILED) return NULL;
+    return board;
+}
 
-    if (has_error) return -1;
+void free_board(void * board, size_t size, int numa_policy) {
+#ifdef HAVE_NUMA
+    if (numa_policy == NUMA_INTERLEAVE && numa_nodes() > 1) {
+        numa_free(board, size);
+        return;
+    }
+#else
+    (void) numa_policy;
+#endif
+    munmap(board, size);
+}
+
+// Counts the pages of a board on every node, as the kernel placed them.
+// Pages that were never touched are not counted. Returns -1 if the
+// placement cannot be queried.
+#define NUMA_QUERY_PAGES 512
+
+int board_pages(void * board, size_t size, unsigned long * pages, int nodes) {
+#ifdef HAVE_NUMA
+    if (numa_available() < 0) return -1;
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t count = (size + page - 1) / page;
+    void * addresses[NUMA_QUERY_PAGES];
+    int status[NUMA_QUERY_PAGES];
+    for (size_t first = 0; first < count; first += NUMA_QUERY_PAGES) {
+        unsigned long batch = count - first < NUMA_QUERY_PAGES ? (unsigned long) (count - first) : NUMA_QUERY_PAGES;
+        for (unsigned long i = 0; i < batch; i++) addresses[i] = (BYTE *) board + (first + i) * page;
+        if (numa_move_pages(0, batch, addresses, NULL, status, 0) != 0) return -1;
+        for (unsigned long i = 0; i < batch; i++) {
+            if (status[i] >= 0 && status[i] < nodes) pages[status[i]]++;
+        }
+    }
+    return 0;
+#else
+    (void) board;
+    (void) size;
+    (void) pages;
+    (void) nodes;
+    return -1;
+#endif
+}
+
+// All memory that lives as long as a board comes from one arena: both
+// generations, the tile flags and statistics, the row buffers of the
+// writers and the output snapshot. The arena is mapped once, for a size
+// computed up front, and unmapped once; the mapping is zeroed and its pages
+// are placed like a board, by first touch or interleaved. An arena without
+// a base only counts, so the same code that lays out a board measures it.
+#define CACHE_LINE 64
+#define ARENA_PAGE 4096
+
+struct ARENA {
+    BYTE * base;
+    size_t size;
+    size_t used;
+    int numa_policy;
+};
+
+size_t align_size(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+struct ARENA measuring_arena() {
+    struct ARENA arena = {NULL, SIZE_MAX, 0, NUMA_FIRST_TOUCH};
+    return arena;
+}
+
+int create_arena(struct ARENA * arena, size_t size, int numa_policy) {
+    arena->size = align_size(size, ARENA_PAGE);
+    arena->used = 0;
+    arena->numa_policy = numa_policy;
+    arena->base = (BYTE *) alloc_board(arena->size, numa_policy);
+    return arena->base == NULL ? -1 : 0;
+}
+
+void * arena_alloc(struct ARENA * arena, size_t size, size_t alignment) {
+    size_t begin = align_size(arena->used, alignment);
+    if (begin + size > arena->size) return NULL;
+    arena->used = begin + size;
+    return arena->base == NULL ? NULL : arena->base + begin;
+}
+
+void destroy_arena(struct ARENA * arena) {
+    if (arena->base != NULL) free_board(arena->base, arena->size, arena->numa_policy);
+    arena->base = NULL;
+}
+
+// Live cells are stored one bit per cell, 64 cells in a word, with the
+// first cell of a row in the lowest bit. Bits past the end of a row are
+// always zero.
+//
+// `diff` and `any` are the OR of old ^ new and of new over all words, so the
+// stable and empty flags never look at single cells. The counters and the
+// bounding box are only filled in when statistics are requested, `hash` only
+// when the board asks for it (see tile_hash).
+struct STATS {
+    uint64_t diff;
+    uint64_t any;
+    uint64_t hash;
+    unsigned long long live;
+    unsigned long long births;
+    unsigned long long deaths;
+    unsigned int min_row;
+    unsigned int max_row;
+    unsigned int min_column;
+    unsigned int max_column;
+};
+
+struct STATS empty_stats() {
+    struct STATS stats = {0, 0, 0, 0, 0, 0, UINT32_MAX, 0, UINT32_MAX, 0};
+    return stats;
+}
+
+void merge_stats(struct STATS * into, struct STATS * from) {
+    into->diff |= from->diff;
+    into->any |= from->any;
+    into->hash ^= from->hash;
+    into->live += from->live;
+    into->births += from->births;
+    into->deaths += from->deaths;
+    if (from->live == 0) return;
+    if (from->min_row < into->min_row) into->min_row = from->min_row;
+    if (from->max_row > into->max_row) into->max_row = from->max_row;
+    if (from->min_column < into->min_column) into->min_column = from->min_column;
+    if (from->max_column > into->max_column) into->max_column = from->max_column;
+}
+
+// The step kernel is also built for the x86-64-v2 (popcnt), v3 (AVX2, BMI)
+// and v4 (AVX-512) levels, and the loader picks the best one for the CPU at
+// startup, so one binary runs at full speed on every machine. CMake defines
+// HAVE_TARGET_CLONES where the compiler can do this. The small functions the
+// kernel calls are always inlined, so every level has its own copy of them.
+#ifdef HAVE_TARGET_CLONES
+#define KERNEL_CLONES __attribute__((target_clones("default", "arch=x86-64-v2", "arch=x86-64-v3", "arch=x86-64-v4")))
+#else
+#define KERNEL_CLONES
+#endif
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+
+// The level of the step kernel the loader has picked.
+char * kernel_level() {
+#ifdef HAVE_TARGET_CLONES
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("x86-64-v4")) return "x86-64-v4";
+    if (__builtin_cpu_supports("x86-64-v3")) return "x86-64-v3";
+    if (__builtin_cpu_supports("x86-64-v2")) return "x86-64-v2";
+    return "x86-64";
+#else
+    return "default";
+#endif
+}
+
+KERNEL_INLINE void count_word(struct STATS * stats, uint64_t old_word, uint64_t new_word, unsigned int k,
+                              unsigned int row, int count) {
+    stats->diff |= old_word ^ new_word;
+    stats->any |= new_word;
+    if (!count) return;
+
+    stats->births += (unsigned long long) __builtin_popcountll(new_word & ~old_word);
+    stats->deaths += (unsigned long long) __builtin_popcountll(old_word & ~new_word);
+    if (new_word == 0) return;
+
+    stats->live += (unsigned long long) __builtin_popcountll(new_word);
+    unsigned int first = k * 64 + (unsigned int) __builtin_ctzll(new_word);
+    unsigned int last = k * 64 + 63 - (unsigned int) __builtin_clzll(new_word);
+    if (row < stats->min_row) stats->min_row = row;
+    if (row > stats->max_row) stats->max_row = row;
+    if (first < stats->min_column) stats->min_column = first;
+    if (last > stats->max_column) stats->max_column = last;
+}
+
+unsigned int row_words(unsigned int width) {
+    return (width + 63) / 64;
+}
 
-    FILE * infile = fopen(input_filename, "r");
-    struct BMP bmp = read_bmp(infile);
-    fclose(infile);
+// Output number `counter` of a splitmix64 stream started at `seed`.
+KERNEL_INLINE uint64_t splitmix64(uint64_t seed, uint64_t counter) {
+    uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t last_word_mask(unsigned int width) {
+    if (width % 64 == 0) return ~0ULL;
+    return (1ULL << (width % 64)) - 1;
+}
+
+// Word k of the row shifted by one cell, so that bit x holds cell x - 1
+// (west) or cell x + 1 (east). The row wraps around.
+KERNEL_INLINE uint64_t west_word(const uint64_t * row, unsigned int k, unsigned int width) {
+    uint64_t carry;
+    if (k > 0) carry = row[k - 1] >> 63;
+    else carry = (row[(width - 1) / 64] >> ((width - 1) % 64)) & 1;
+    return (row[k] << 1) | carry;
+}
+
+KERNEL_INLINE uint64_t east_word(const uint64_t * row, unsigned int k, unsigned int words, unsigned int width) {
+    uint64_t carry;
+    if (k + 1 < words) carry = row[k + 1] << 63;
+    else carry = (row[0] & 1) << ((width - 1) % 64);
+    return (row[k] >> 1) | carry;
+}
+
+// Computes words [k_begin, k_end) of one row of the next generation. The
+// eight neighbours are added bitwise: s0 and s1 are the low bits of the
+// count and s2 is set once the count reaches four. With `hash` the new
+// words are also hashed the way tile_hash does it, while they are still in
+// registers.
+KERNEL_CLONES void step_words(const uint64_t * above, const uint64_t * row, const uint64_t * below, uint64_t * out,
+                unsigned int k_begin, unsigned int k_end, unsigned int width, unsigned int row_index,
+                struct STATS * stats, int count, int hash) {
+    unsigned int words = row_words(width);
 
-    unsigned int height = (unsigned int) bmp.bitmapinfo.biHeight;
-    unsigned int width = (unsigned int) bmp.bitmapinfo.biWidth;
+    for (unsigned int k = k_begin; k < k_end; k++) {
+        uint64_t neighbours[8] = {
+                west_word(above, k, width), above[k], east_word(above, k, words, width),
+                west_word(row, k, width), east_word(row, k, words, width),
+                west_word(below, k, width), below[k], east_word(below, k, words, width)
+        };
+        uint64_t s0 = 0;
+        uint64_t s1 = 0;
+        uint64_t s2 = 0;
+        for (int n = 0; n < 8; n++) {
+            uint64_t carry0 = s0 & neighbours[n];
+            s0 ^= neighbours[n];
+            uint64_t carry1 = s1 & carry0;
+            s1 ^= carry0;
+            s2 |= carry1;
+        }
+
+        uint64_t next = s1 & ~s2 & (s0 | row[k]);
+        if (k == words - 1) next &= last_word_mask(width);
+        out[k] = next;
+        count_word(stats, row[k], next, k, row_index, count);
+        if (hash && next != 0) stats->hash ^= splitmix64(next, (uint64_t) row_index * words + k);
+    }
+}
+
+void pack_row(struct PIXEL * pixels, unsigned int width, uint64_t * row) {
+    struct PIXEL black = pixel(0, 0, 0);
+    memset(row, 0, row_words(width) * sizeof(uint64_t));
+    for (unsigned int j = 0; j < width; j++) {
+        if (eq_pixel(pixels[j], black) == 1) row[j / 64] |= 1ULL << (j % 64);
+    }
+}
 
-    struct PIXEL * pixels = bmp.pixelsdata.data;
-    struct PIXEL * start_pixels = bmp.pixelsdata.data;
+void unpack_row(const uint64_t * row, unsigned int width, struct PIXEL * pixels) {
     struct PIXEL black = pixel(0, 0, 0);
     struct PIXEL white = pixel(255, 255, 255);
+    for (unsigned int j = 0; j < width; j++) {
+        pixels[j] = (row[j / 64] >> (j % 64)) & 1 ? black : white;
+    }
+}
 
-    fclose(fopen(output_filename, "w"));
+// A tile is tile_size rows high and tile_size cells, rounded up to whole
+// words, wide. tile_alive and tile_changed describe the current generation,
+// the new_ arrays are filled while the next one is computed.
+struct LIFE {
+    unsigned int width;
+    unsigned int height;
+    unsigned int words;
+    unsigned int tile_size;
+    unsigned int tile_words;
+    unsigned int tiles_x;
+    unsigned int tiles_y;
+    int numa_policy;
+    int count_stats;
+    int hash_cells;
+    uint64_t * cells;
+    uint64_t * new_cells;
+    BYTE * tile_alive;
+    BYTE * new_tile_alive;
+    BYTE * tile_changed;
+    BYTE * new_tile_changed;
+    struct STATS * tile_stats;
+    struct PIXEL * row_pixels;
+    unsigned int * row_counts;
+    unsigned int * run_starts;
+    unsigned int * run_lengths;
+    struct ARENA arena;
+    size_t board_bytes;
+    size_t tile_bytes;
+    size_t extra_bytes;
+};
 
-    int stable_flag = 1;
-    int empty_flag = 1;
+// Takes the buffers of a board from its arena. Both generations come first
+// and on their own pages, so the small arrays after them never share a page
+// with the cells a worker touches first.
+void layout_life(struct LIFE * life) {
+    struct ARENA * arena = &life->arena;
+    size_t board = (size_t) life->words * life->height * sizeof(uint64_t);
+    size_t tiles = (size_t) life->tiles_x * life->tiles_y;
+    life->cells = (uint64_t *) arena_alloc(arena, board, ARENA_PAGE);
+    life->new_cells = (uint64_t *) arena_alloc(arena, board, ARENA_PAGE);
+    life->board_bytes = align_size(arena->used, ARENA_PAGE);
+    arena->used = life->board_bytes;
 
-    for (unsigned int time = 0; time < max_iter; time++) {
+    life->tile_alive = (BYTE *) arena_alloc(arena, tiles, CACHE_LINE);
+    life->new_tile_alive = (BYTE *) arena_alloc(arena, tiles, CACHE_LINE);
+    life->tile_changed = (BYTE *) arena_alloc(arena, tiles, CACHE_LINE);
+    life->new_tile_changed = (BYTE *) arena_alloc(arena, tiles, CACHE_LINE);
+    life->tile_stats = (struct STATS *) arena_alloc(arena, tiles * sizeof(struct STATS), CACHE_LINE);
+    life->row_pixels = (struct PIXEL *) arena_alloc(arena, (size_t) life->width * 3, CACHE_LINE);
+    life->row_counts = (unsigned int *) arena_alloc(arena, (size_t) life->width * sizeof(unsigned int), CACHE_LINE);
+    life->run_starts = (unsigned int *) arena_alloc(arena, (life->width / 2 + 1) * sizeof(unsigned int), CACHE_LINE);
+    life->run_lengths = (unsigned int *) arena_alloc(arena, (life->width / 2 + 1) * sizeof(unsigned int), CACHE_LINE);
+    life->tile_bytes = align_size(arena->used, CACHE_LINE) - life->board_bytes;
+}
 
-        sleep(dump_freq);
-        printf("time: %d ", time);
+// `extra` bytes stay free in the arena for buffers of the caller, e.g. the
+// compressed stripes of the output snapshot. Returns a board without cells
+// if the arena cannot be mapped.
+struct LIFE create_life(unsigned int width, unsigned int height, unsigned int tile_size, int numa_policy,
+                        int count_stats, size_t extra) {
+    struct LIFE life;
+    memset(&life, 0, sizeof(life));
+    life.width = width;
+    life.height = height;
+    life.words = row_words(width);
+    life.tile_size = tile_size;
+    life.tile_words = row_words(tile_size);
+    life.tiles_x = (life.words + life.tile_words - 1) / life.tile_words;
+    life.tiles_y = (height + tile_size - 1) / tile_size;
+    life.numa_policy = numa_policy;
+    life.count_stats = count_stats;
+    life.extra_bytes = extra;
 
-        struct PIXEL * new_pixels = (struct PIXEL *) calloc(width * height, 24);
-        stable_flag = 1;
-        empty_flag = 1;
+    life.arena = measuring_arena();
+    layout_life(&life);
+    if (create_arena(&life.arena, life.board_bytes + life.tile_bytes + extra, numa_policy) != 0) {
+        life.cells = NULL;
+        life.new_cells = NULL;
+        return life;
+    }
+    layout_life(&life);
+    return life;
+}
 
-        for (unsigned int i = 0; i < height; i++) {
-            for (unsigned int j = 0; j < width; j++) {
-                unsigned int count = 0;
-
-                unsigned int index = get_index((height + i) % height, (width + j) % width, &bmp);
-
-                if (eq_pixel(pixels[get_index((height + i - 1) % height, (width + j - 1) % width, &bmp)], black) == 1) count++;
-                if (eq_pixel(pixels[get_index((height + i - 1) % height, (width + j) % width, &bmp)], black) == 1) count++;
-                if (eq_pixel(pixels[get_index((height + i - 1) % height, (width + j + 1) % width, &bmp)], black) == 1) count++;
-                if (eq_pixel(pixels[get_index((height + i) % height, (width + j - 1) % width, &bmp)], black) == 1) count++;
-                if (eq_pixel(pixels[get_index((height + i) % height, (width + j + 1) % width, &bmp)], black) == 1) count++;
-                if (eq_pixel(pixels[get_index((height + i + 1) % height, (width + j - 1) % width, &bmp)], black) == 1) count++;
-                if (eq_pixel(pixels[get_index((height + i + 1) % height, (width + j) % width, &bmp)], black) == 1) count++;
-                if (eq_pixel(pixels[get_index((height + i + 1) % height, (width + j + 1) % width, &bmp)], black) == 1) count++;
-
-                if (eq_pixel(pixels[index], black) == 1) {
-                    if (count == 2 || count == 3) {
-                        new_pixels[index] = black;
-                        empty_flag = 0;
-                    } else {
-                        new_pixels[index] = white;
-                    }
-                } else if (eq_pixel(pixels[index], white) == 1) {
-                    if (count == 3) {
-                        new_pixels[index] = black;
-                        empty_flag = 0;
-                    } else {
-                        new_pixels[index] = white;
-                    }
-                } else {
-                    struct PIXEL p = pixels[index];
-                    fprintf(stderr, "Error: Unsupported color {r: %d, g: %d, b: %d}\n", p.r, p.g, p.b);
-                }
+void destroy_life(struct LIFE * life) {
+    destroy_arena(&life->arena);
+}
 
-                if (eq_pixel(pixels[index], new_pixels[index]) == 0) {
-                    stable_flag = 0;
-                }
-            }
+void print_memory_budget(struct LIFE * life) {
+    printf("memory: %zu bytes in one arena (generations %zu, tiles and rows %zu, snapshot, cycles and pipeline %zu)\n",
+           life->arena.size, life->board_bytes, life->tile_bytes, life->extra_bytes);
+}
+
+void swap_life(struct LIFE * life) {
+    uint64_t * cells = life->cells;
+    life->cells = life->new_cells;
+    life->new_cells = cells;
+
+    BYTE * tile_alive = life->tile_alive;
+    life->tile_alive = life->new_tile_alive;
+    life->new_tile_alive = tile_alive;
+
+    BYTE * tile_changed = life->tile_changed;
+    life->tile_changed = life->new_tile_changed;
+    life->new_tile_changed = tile_changed;
+}
+
+uint64_t * life_row(struct LIFE * life, uint64_t * cells, unsigned int row) {
+    return cells + (size_t) row * life->words;
+}
+
+struct STATS life_stats(struct LIFE * life) {
+    struct STATS stats = empty_stats();
+    for (unsigned int tile = 0; tile < life->tiles_x * life->tiles_y; tile++) {
+        merge_stats(&stats, &life->tile_stats[tile]);
+    }
+    return stats;
+}
+
+// Finds stable and periodic boards with a period of up to CYCLE_PERIOD
+// generations. The hash of every generation goes into a ring; when a hash
+// comes back after p generations, the board is copied and compared with the
+// board p generations later, so a hash collision never ends a run.
+//
+// Hashing costs about a tenth of a step and the copy a second board, while a
+// soup takes thousands of generations to settle, so with --cycles auto only
+// runs of at least CYCLE_MIN_ITER generations look for cycles.
+#define CYCLE_PERIOD 1024
+#define CYCLE_MIN_ITER 1000
+
+#define CYCLES_AUTO (-1)
+#define CYCLES_OFF 0
+#define CYCLES_ON 1
+
+struct CYCLE {
+    uint64_t * hashes;
+    uint64_t * cells;
+    size_t board_bytes;
+    unsigned int recorded;
+    unsigned int period;
+    unsigned int generation;
+};
+
+size_t cycle_bytes(unsigned int width, unsigned int height) {
+    return CYCLE_PERIOD * sizeof(uint64_t) + (size_t) row_words(width) * height * sizeof(uint64_t) + 2 * CACHE_LINE;
+}
+
+// Takes the ring and the copy of the board from the arena of the board,
+// which must have cycle_bytes to spare, and turns on the tile hashes. Called
+// before the board is filled, so the first generation is hashed, too.
+int create_cycle(struct CYCLE * cycle, struct LIFE * life) {
+    memset(cycle, 0, sizeof(struct CYCLE));
+    cycle->board_bytes = (size_t) life->words * life->height * sizeof(uint64_t);
+    cycle->hashes = (uint64_t *) arena_alloc(&life->arena, CYCLE_PERIOD * sizeof(uint64_t), CACHE_LINE);
+    cycle->cells = (uint64_t *) arena_alloc(&life->arena, cycle->board_bytes, CACHE_LINE);
+    if (cycle->hashes == NULL || cycle->cells == NULL) {
+        fprintf(stderr, "Error: Not enough memory for the cycle detector\n");
+        return -1;
+    }
+    life->hash_cells = 1;
+    return 0;
+}
+
+// Returns the period once the board of `generation` is known to repeat.
+unsigned int find_cycle(struct CYCLE * cycle, struct LIFE * life, unsigned int generation, uint64_t hash) {
+    unsigned int period = 0;
+    if (cycle->period > 0) {
+        if (generation == cycle->generation + cycle->period) {
+            if (memcmp(life->cells, cycle->cells, cycle->board_bytes) == 0) period = cycle->period;
+            cycle->period = 0;
         }
+    } else {
+        for (unsigned int p = 2; p <= cycle->recorded && p <= CYCLE_PERIOD; p++) {
+            if (cycle->hashes[(generation - p) % CYCLE_PERIOD] != hash) continue;
+            cycle->period = p;
+            cycle->generation = generation;
+            memcpy(cycle->cells, life->cells, cycle->board_bytes);
+            break;
+        }
+    }
+    cycle->hashes[generation % CYCLE_PERIOD] = hash;
+    cycle->recorded++;
+    return period;
+}
 
-        if (bmp.pixelsdata.data != start_pixels) free(bmp.pixelsdata.data);
+void write_life(struct LIFE * life, struct BMP * bmp, FILE * outfile) {
+    long mul = 3 * (long) life->width;
+    long dif = 0;
+    if (mul % 4 != 0) dif = 4 - mul % 4;
 
-        bmp.pixelsdata.data = new_pixels;
-        pixels = new_pixels;
+    struct PIXEL * pixels = life->row_pixels;
+    fwrite(&bmp->bitmapfileheader, sizeof(bmp->bitmapfileheader), 1, outfile);
+    fwrite(&bmp->bitmapinfo, sizeof(bmp->bitmapinfo), 1, outfile);
+    for (unsigned int i = 0; i < life->height; i++) {
+        unpack_row(life_row(life, life->cells, i), life->width, pixels);
+        fwrite(pixels, 3, life->width, outfile);
+        fseek(outfile, dif, SEEK_CUR);
+    }
+    fflush(outfile);
+}
 
-        FILE * outfile = fopen(output_filename, "w");
-        write_bmp(&bmp, outfile);
-        printf("written\n");
+// Returns 1 if none of the tile and its eight neighbour tiles has its flag set.
+int tile_is_quiet(struct LIFE * life, BYTE * flags, unsigned int tx, unsigned int ty) {
+    for (unsigned int dy = 0; dy < 3; dy++) {
+        for (unsigned int dx = 0; dx < 3; dx++) {
+            unsigned int y = (ty + life->tiles_y + dy - 1) % life->tiles_y;
+            unsigned int x = (tx + life->tiles_x + dx - 1) % life->tiles_x;
+            if (flags[y * life->tiles_x + x]) return 0;
+        }
+    }
+    return 1;
+}
 
-        if (stable_flag == 1) {
-            printf("The Game of Life is stable");
-            return 0;
+void tile_bounds(struct LIFE * life, unsigned int tile, unsigned int * row_begin, unsigned int * row_end,
+                 unsigned int * k_begin, unsigned int * k_end) {
+    unsigned int tx = tile % life->tiles_x;
+    unsigned int ty = tile / life->tiles_x;
+    *row_begin = ty * life->tile_size;
+    *row_end = *row_begin + life->tile_size < life->height ? *row_begin + life->tile_size : life->height;
+    *k_begin = tx * life->tile_words;
+    *k_end = *k_begin + life->tile_words < life->words ? *k_begin + life->tile_words : life->words;
+}
+
+// A hash of the live words of a tile and their positions. The hash of a
+// board is the XOR of the hashes of its tiles, so a tile that was skipped
+// keeps its hash and an empty tile adds nothing.
+uint64_t tile_hash(struct LIFE * life, uint64_t * cells, unsigned int row_begin, unsigned int row_end,
+                   unsigned int k_begin, unsigned int k_end) {
+    uint64_t hash = 0;
+    for (unsigned int i = row_begin; i < row_end; i++) {
+        uint64_t * row = life_row(life, cells, i);
+        for (unsigned int k = k_begin; k < k_end; k++) {
+            if (row[k] != 0) hash ^= splitmix64(row[k], (uint64_t) i * life->words + k);
         }
-        if (empty_flag == 1) {
-            printf("The Game of Life is dead");
-            return 0;
+    }
+    return hash;
+}
+
+// Sets the flags and statistics of a tile from the cells it holds, as if
+// all of them had just been born into an unknown history.
+void scan_tile(struct LIFE * life, unsigned int tile) {
+    unsigned int row_begin, row_end, k_begin, k_end;
+    tile_bounds(life, tile, &row_begin, &row_end, &k_begin, &k_end);
+
+    struct STATS stats = empty_stats();
+    for (unsigned int i = row_begin; i < row_end; i++) {
+        uint64_t * row = life_row(life, life->cells, i);
+        for (unsigned int k = k_begin; k < k_end; k++) count_word(&stats, 0, row[k], k, i, 1);
+    }
+    stats.births = 0;
+    stats.diff = 0;
+    if (life->hash_cells) stats.hash = tile_hash(life, life->cells, row_begin, row_end, k_begin, k_end);
+    life->tile_alive[tile] = stats.any != 0;
+    life->tile_changed[tile] = 1;
+    life->tile_stats[tile] = stats;
+}
+
+// Packs one tile of the source image into the board, or clears it if there
+// is no source image. Called by the worker that owns the tile, so the pages
+// of its band end up on its NUMA node.
+void touch_tile(struct LIFE * life, unsigned int tile, struct PIXEL * source) {
+    unsigned int row_begin, row_end, k_begin, k_end;
+    tile_bounds(life, tile, &row_begin, &row_end, &k_begin, &k_end);
+    unsigned int column_end = k_end * 64 < life->width ? k_end * 64 : life->width;
+
+    struct PIXEL black = pixel(0, 0, 0);
+    for (unsigned int i = row_begin; i < row_end; i++) {
+        uint64_t * row = life_row(life, life->cells, i);
+        memset(row + k_begin, 0, (k_end - k_begin) * sizeof(uint64_t));
+        memset(life_row(life, life->new_cells, i) + k_begin, 0, (k_end - k_begin) * sizeof(uint64_t));
+        for (unsigned int j = k_begin * 64; source != NULL && j < column_end; j++) {
+            if (eq_pixel(source[(size_t) i * life->width + j], black) == 1) row[j / 64] |= 1ULL << (j % 64);
         }
     }
-    return 0;
-}
\ No newline at end of file
+    scan_tile(life, tile);
+}
+
+// Computes one tile of the next generation. Returns 0 if the tile was skipped.
+//
+// If nothing changed around the tile in the last generation, the tile does
+// not change either. The next buffer still holds the previous generation,
+// which is equal to the current one there, so not even a copy is needed.
+// A tile with no live cells around it is simply cleared.
+int step_tile(struct LIFE * life, unsigned int tile) {
+    unsigned int row_begin, row_end, k_begin, k_end;
+    tile_bounds(life, tile, &row_begin, &row_end, &k_begin, &k_end);
+    unsigned int tx = tile % life->tiles_x;
+    unsigned int ty = tile / life->tiles_x;
+
+    if (tile_is_quiet(life, life->tile_changed, tx, ty)) {
+        life->tile_stats[tile].diff = 0;
+        life->tile_stats[tile].births = 0;
+        life->tile_stats[tile].deaths = 0;
+        life->new_tile_alive[tile] = life->tile_alive[tile];
+        life->new_tile_changed[tile] = 0;
+        return 0;
+    }
+
+    struct STATS stats = empty_stats();
+    if (tile_is_quiet(life, life->tile_alive, tx, ty)) {
+        for (unsigned int i = row_begin; i < row_end; i++) {
+            memset(life_row(life, life->new_cells, i) + k_begin, 0, (k_end - k_begin) * sizeof(uint64_t));
+        }
+        life->new_tile_alive[tile] = 0;
+        life->new_tile_changed[tile] = 0;
+        life->tile_stats[tile] = stats;
+        return 0;
+    }
+
+    for (unsigned int i = row_begin; i < row_end; i++) {
+        step_words(life_row(life, life->cells, (i + life->height - 1) % life->height),
+                   life_row(life, life->cells, i),
+                   life_row(life, life->cells, (i + 1) % life->height),
+                   life_row(life, life->new_cells, i),
+                   k_begin, k_end, life->width, i, &stats, life->count_stats, life->hash_cells);
+    }
+    life->new_tile_alive[tile] = stats.any != 0;
+    life->new_tile_changed[tile] = stats.diff != 0;
+    life->tile_stats[tile] = stats;
+    return 1;
+}
+
+// Sets one cell of the board and keeps the flags and statistics of its tile
+// up to date. Pattern rows go down, board rows go up like the rows of a .bmp
+// file, so pattern row y is board row height - 1 - y.
+void life_set_cell(struct LIFE * life, unsigned int x, unsigned int row) {
+    uint64_t * word = life_row(life, life->cells, row) + x / 64;
+    uint64_t bit = 1ULL << (x % 64);
+    if (*word & bit) return;
+    *word |= bit;
+
+    unsigned int tile = (row / life->tile_size) * life->tiles_x + x / 64 / life->tile_words;
+    life->tile_alive[tile] = 1;
+    count_word(&life->tile_stats[tile], 0, bit, x / 64, row, 1);
+    life->tile_stats[tile].births = 0;
+    life->tile_stats[tile].diff = 0;
+}
+
+void place_pattern(struct LIFE * life, struct PATTERN * pattern, unsigned int offset_x, unsigned int offset_y) {
+    for (unsigned int i = 0; i < pattern->runs; i++) {
+        struct RUN run = pattern->data[i];
+        unsigned int row = life->height - 1 - (offset_y + run.y) % life->height;
+        for (unsigned int j = 0; j < run.length && j < life->width; j++) {
+            life_set_cell(life, (offset_x + run.x + j) % life->width, row);
+        }
+    }
+
+    // life_set_cell does not hash, the tiles are hashed once the pattern is in.
+    for (unsigned int tile = 0; life->hash_cells && tile < life->tiles_x * life->tiles_y; tile++) {
+        unsigned int row_begin, row_end, k_begin, k_end;
+        tile_bounds(life, tile, &row_begin, &row_end, &k_begin, &k_end);
+        life->tile_stats[tile].hash = tile_hash(life, life->cells, row_begin, row_end, k_begin, k_end);
+    }
+}
+
+// Random soups come from a counter-based generator: cell x of board row
+// `row` takes output number row * width + x of a splitmix64 stream, so the
+// soup depends only on the seed and not on which thread fills which tile.
+void random_words(struct INPUT * input, unsigned int row, unsigned int k_begin, unsigned int k_end, uint64_t * cells) {
+    // A cell is alive if the top 53 bits of its number are below density * 2^53.
+    uint64_t threshold = (uint64_t) (input->density * 9007199254740992.0);
+    unsigned int column_end = k_end * 64 < input->width ? k_end * 64 : input->width;
+    uint64_t counter = (uint64_t) row * input->width;
+    for (unsigned int k = k_begin; k < k_end; k++) {
+        uint64_t word = 0;
+        for (unsigned int j = k * 64; j < column_end && j < k * 64 + 64; j++) {
+            if (splitmix64(input->seed, counter + j) >> 11 < threshold) word |= 1ULL << (j % 64);
+        }
+        cells[k] = word;
+    }
+}
+
+// Fills one tile with the random soup, in place of touch_tile.
+void random_tile(struct LIFE * life, unsigned int tile, struct INPUT * input) {
+    unsigned int row_begin, row_end, k_begin, k_end;
+    tile_bounds(life, tile, &row_begin, &row_end, &k_begin, &k_end);
+    for (unsigned int i = row_begin; i < row_end; i++) {
+        random_words(input, i, k_begin, k_end, life_row(life, life->cells, i));
+        memset(life_row(life, life->new_cells, i) + k_begin, 0, (k_end - k_begin) * sizeof(uint64_t));
+    }
+    scan_tile(life, tile);
+}
+
+void rle_token(FILE * file, unsigned int count, char tag, unsigned int * column) {
+    char token[16];
+    int length = count > 1 ? sprintf(token, "%u%c", count, tag) : sprintf(token, "%c", tag);
+    if (*column + length > 70) {
+        fputc('\n', file);
+        *column = 0;
+    }
+    fputs(token, file);
+    *column += length;
+}
+
+// Finds the live runs of one board row word by word, so a row costs one
+// test per word plus one step per run.
+unsigned int row_runs(struct LIFE * life, unsigned int row, unsigned int * starts, unsigned int * lengths) {
+    uint64_t * cells = life_row(life, life->cells, row);
+    unsigned int runs = 0;
+    for (unsigned int k = 0; k < life->words; k++) {
+        uint64_t word = cells[k];
+        unsigned int shift = 0;
+        while (word != 0) {
+            unsigned int start = (unsigned int) __builtin_ctzll(word);
+            uint64_t rest = ~(word >> start);
+            unsigned int length = rest == 0 ? 64 - start : (unsigned int) __builtin_ctzll(rest);
+            unsigned int x = k * 64 + shift + start;
+            if (runs > 0 && starts[runs - 1] + lengths[runs - 1] == x) {
+                lengths[runs - 1] += length;
+            } else {
+                starts[runs] = x;
+                lengths[runs] = length;
+                runs++;
+            }
+            if (start + length >= 64) break;
+            word >>= start + length;
+            shift += start + length;
+        }
+    }
+    return runs;
+}
+
+int tile_row_alive(struct LIFE * life, unsigned int row) {
+    BYTE * flags = life->tile_alive + (row / life->tile_size) * life->tiles_x;
+    for (unsigned int tx = 0; tx < life->tiles_x; tx++) {
+        if (flags[tx]) return 1;
+    }
+    return 0;
+}
+
+// Writes the board in RLE format. Rows without live tiles are skipped
+// without being read.
+void write_rle(struct LIFE * life, FILE * file, unsigned int generation) {
+    unsigned int * starts = life->run_starts;
+    unsigned int * lengths = life->run_lengths;
+    unsigned int column = 0;
+    unsigned int rows = 0;
+
+    fprintf(file, "#CXRLE Pos=0,0 Gen=%u\n", generation);
+    fprintf(file, "x = %u, y = %u, rule = B3/S23\n", life->width, life->height);
+    for (unsigned int y = 0; y < life->height; y++) {
+        unsigned int row = life->height - 1 - y;
+        unsigned int runs = tile_row_alive(life, row) ? row_runs(life, row, starts, lengths) : 0;
+        if (runs == 0) {
+            rows++;
+            continue;
+        }
+        if (y > 0 && rows > 0) rle_token(file, rows, '$', &column);
+        rows = 1;
+
+        unsigned int x = 0;
+        for (unsigned int i = 0; i < runs; i++) {
+            if (starts[i] > x) rle_token(file, starts[i] - x, 'b', &column);
+            rle_token(file, lengths[i], 'o', &column);
+            x = starts[i] + lengths[i];
+        }
+    }
+    fputs("!\n", file);
+    fflush(file);
+}
+
+void write_cells(struct LIFE * life, FILE * file, unsigned int generation) {
+    unsigned int * starts = life->run_starts;
+    unsigned int * lengths = life->run_lengths;
+
+    fprintf(file, "!Generation: %u\n", generation);
+    for (unsigned int y = 0; y < life->height; y++) {
+        unsigned int row = life->height - 1 - y;
+        unsigned int runs = tile_row_alive(life, row) ? row_runs(life, row, starts, lengths) : 0;
+        unsigned int x = 0;
+        for (unsigned int i = 0; i < runs; i++) {
+            for (; x < starts[i]; x++) fputc('.', file);
+            for (; x < starts[i] + lengths[i]; x++) fputc('O', file);
+        }
+        fputc('\n', file);
+    }
+    fflush(file);
+}
+
+// A region of interest is a window of the board, in cells, with y counted
+// from the top like in a picture. It is written as a .bmp image that is
+// `scale` times smaller: a pixel is black if any of its cells is alive, or
+// gray by the share of live cells. Every region has its own scale, so one
+// run can write an overview of the board and details of it. Only the rows
+// and words of the window are read, so the cost follows the size of the
+// window, not of the board.
+#define SCALE_OR 0
+#define SCALE_DENSITY 1
+
+struct REGION {
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+    unsigned int scale;
+    char * filename;
+    FILE * file;
+};
+
+unsigned int count_bits(const uint64_t * row, unsigned int begin, unsigned int end) {
+    unsigned int count = 0;
+    while (begin < end) {
+        unsigned int shift = begin % 64;
+        unsigned int bits = 64 - shift < end - begin ? 64 - shift : end - begin;
+        uint64_t word = row[begin / 64] >> shift;
+        if (bits < 64) word &= (1ULL << bits) - 1;
+        count += (unsigned int) __builtin_popcountll(word);
+        begin += bits;
+    }
+    return count;
+}
+
+void write_region(struct LIFE * life, struct REGION * region, int mode, FILE * outfile) {
+    unsigned int scale = region->scale;
+    unsigned int width = (region->width + scale - 1) / scale;
+    unsigned int height = (region->height + scale - 1) / scale;
+    struct BMP bmp = create_bmp(width, height, NULL);
+    long mul = 3 * (long) width;
+    long dif = 0;
+    if (mul % 4 != 0) dif = 4 - mul % 4;
+
+    unsigned int * counts = life->row_counts;
+    struct PIXEL * pixels = life->row_pixels;
+    fwrite(&bmp.bitmapfileheader, sizeof(bmp.bitmapfileheader), 1, outfile);
+    fwrite(&bmp.bitmapinfo, sizeof(bmp.bitmapinfo), 1, outfile);
+    for (unsigned int i = 0; i < height; i++) {
+        unsigned int top = region->y + (height - 1 - i) * scale;
+        unsigned int bottom = top + scale < region->y + region->height ? top + scale : region->y + region->height;
+        memset(counts, 0, width * sizeof(unsigned int));
+        for (unsigned int y = top; y < bottom; y++) {
+            uint64_t * row = life_row(life, life->cells, life->height - 1 - y);
+            for (unsigned int j = 0; j < width; j++) {
+                unsigned int begin = region->x + j * scale;
+                unsigned int end = begin + scale < region->x + region->width ? begin + scale : region->x + region->width;
+                counts[j] += count_bits(row, begin, end);
+            }
+        }
+        for (unsigned int j = 0; j < width; j++) {
+            unsigned int begin = region->x + j * scale;
+            unsigned int end = begin + scale < region->x + region->width ? begin + scale : region->x + region->width;
+            unsigned int cells = (bottom - top) * (end - begin);
+            BYTE value = 255;
+            if (mode == SCALE_OR) value = counts[j] > 0 ? 0 : 255;
+            else value = (BYTE) (255 - (counts[j] * 255 + cells / 2) / cells);
+            pixels[j] = pixel(value, value, value);
+        }
+        fwrite(pixels, 3, width, outfile);
+        fseek(outfile, dif, SEEK_CUR);
+    }
+    fflush(outfile);
+}
+
+// The files of the regions are opened once and rewritten in place.
+void write_regions(struct LIFE * life, struct REGION * regions, unsigned int count, int mode) {
+    for (unsigned int i = 0; i < count; i++) {
+        rewind(regions[i].file);
+        write_region(life, &regions[i], mode, regions[i].file);
+    }
+}
+
+// With several regions, region i of <name>.<extension> goes to
+// <name>_<i>.<extension>, and of a name without an extension to <name>_<i>.
+// Returns NULL if there is no memory for the name.
+char * region_filename(char * output_filename, unsigned int index, unsigned int count) {
+    if (count == 1) return output_filename;
+    char * dot = strrchr(output_filename, '.');
+    char * slash = strrchr(output_filename, '/');
+    if (dot == NULL || (slash != NULL && dot < slash) || dot == output_filename || dot[-1] == '/') {
+        dot = output_filename + strlen(output_filename);
+    }
+    size_t size = strlen(output_filename) + 16;
+    char * filename = (char *) malloc(size);
+    if (filename == NULL) return NULL;
+    snprintf(filename, size, "%.*s_%u%s", (int) (dot - output_filename), output_filename, index, dot);
+    return filename;
+}
+
+// A snapshot holds the packed board: the header, the compressed size of
+// every stripe of rows, and the compressed stripes. Stripes are compressed
+// and decompressed independently, in parallel. Words are stored in the byte
+// order of the machine, which is little-endian on all our targets.
+#define CODEC_NONE 0
+#define CODEC_ZRLE 1
+#define CODEC_LZ4 2
+#define CODEC_ZSTD 3
+
+#pragma pack(push, 1)
+
+struct SNAPSHOT_HEADER {
+    DWORD magic;
+    WORD version;
+    WORD codec;
+    DWORD width;
+    DWORD height;
+    uint64_t generation;
+    DWORD stripe_rows;
+    DWORD stripes;
+};
+
+#pragma pack(pop)
+
+#define SNAPSHOT_MAGIC 0x534C4F47
+
+struct SNAPSHOT {
+    struct SNAPSHOT_HEADER header;
+    size_t bound;
+    BYTE * buffers;
+    DWORD * sizes;
+    struct ARENA * arena;
+};
+
+char * codec_name(int codec) {
+    if (codec == CODEC_ZRLE) return "zrle";
+    if (codec == CODEC_LZ4) return "lz4";
+    if (codec == CODEC_ZSTD) return "zstd";
+    return "none";
+}
+
+int codec_by_name(char * name) {
+    if (strcmp(name, "none") == 0) return CODEC_NONE;
+    if (strcmp(name, "zrle") == 0) return CODEC_ZRLE;
+#ifdef HAVE_LZ4
+    if (strcmp(name, "lz4") == 0) return CODEC_LZ4;
+#endif
+#ifdef HAVE_ZSTD
+    if (strcmp(name, "zstd") == 0) return CODEC_ZSTD;
+#endif
+    return -1;
+}
+
+int default_codec() {
+#ifdef HAVE_ZSTD
+    return CODEC_ZSTD;
+#elif defined(HAVE_LZ4)
+    return CODEC_LZ4;
+#else
+    return CODEC_ZRLE;
+#endif
+}
+
+size_t put_varint(BYTE * out, uint64_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (BYTE) (value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (BYTE) value;
+    return length;
+}
+
+size_t get_varint(const BYTE * in, size_t size, size_t * position, uint64_t * value) {
+    *value = 0;
+    for (unsigned int shift = 0; *position < size && shift < 64; shift += 7) {
+        BYTE byte = in[(*position)++];
+        *value |= (uint64_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return 1;
+    }
+    return 0;
+}
+
+// The built-in codec, used when neither LZ4 nor zstd is available: pairs of
+// (number of zero words, number of literal words) followed by the literals.
+// Dead space costs a couple of bytes however large it is.
+size_t zrle_compress(const uint64_t * words, size_t count, BYTE * out) {
+    size_t length = 0;
+    size_t i = 0;
+    while (i < count) {
+        size_t zeros = 0;
+        while (i + zeros < count && words[i + zeros] == 0) zeros++;
+        size_t literals = 0;
+        while (i + zeros + literals < count && words[i + zeros + literals] != 0) literals++;
+        length += put_varint(out + length, zeros);
+        length += put_varint(out + length, literals);
+        memcpy(out + length, words + i + zeros, literals * sizeof(uint64_t));
+        length += literals * sizeof(uint64_t);
+        i += zeros + literals;
+    }
+    return length;
+}
+
+int zrle_decompress(const BYTE * in, size_t size, uint64_t * words, size_t count) {
+    size_t position = 0;
+    size_t i = 0;
+    while (position < size) {
+        uint64_t zeros, literals;
+        if (!get_varint(in, size, &position, &zeros) || !get_varint(in, size, &position, &literals)) return -1;
+        if (zeros > count - i || literals > count - i - zeros) return -1;
+        if (position + literals * sizeof(uint64_t) > size) return -1;
+        memset(words + i, 0, zeros * sizeof(uint64_t));
+        memcpy(words + i + zeros, in + position, literals * sizeof(uint64_t));
+        position += literals * sizeof(uint64_t);
+        i += zeros + literals;
+    }
+    return i == count ? 0 : -1;
+}
+
+size_t codec_bound(int codec, size_t size) {
+#ifdef HAVE_LZ4
+    if (codec == CODEC_LZ4) return (size_t) LZ4_compressBound((int) size);
+#endif
+#ifdef HAVE_ZSTD
+    if (codec == CODEC_ZSTD) return ZSTD_compressBound(size);
+#endif
+    if (codec == CODEC_ZRLE) return size + 2 * 10 * (size / sizeof(uint64_t) + 1);
+    return size;
+}
+
+// Takes the buffers from an arena if one is given, or from the heap.
+struct SNAPSHOT create_snapshot(unsigned int width, unsigned int height, int codec, struct ARENA * arena) {
+    struct SNAPSHOT snapshot;
+    unsigned int row_bytes = row_words(width) * (unsigned int) sizeof(uint64_t);
+    unsigned int stripe_rows = (1u << 20) / row_bytes;
+    if (stripe_rows == 0) stripe_rows = 1;
+    if (stripe_rows > height) stripe_rows = height;
+
+    struct SNAPSHOT_HEADER header = {SNAPSHOT_MAGIC, 1, (WORD) codec, width, height, 0,
+                                     stripe_rows, (height + stripe_rows - 1) / stripe_rows};
+    snapshot.header = header;
+    snapshot.bound = codec_bound(codec, (size_t) stripe_rows * row_bytes);
+    snapshot.arena = arena;
+    if (arena != NULL) {
+        snapshot.buffers = (BYTE *) arena_alloc(arena, snapshot.bound * header.stripes, CACHE_LINE);
+        snapshot.sizes = (DWORD *) arena_alloc(arena, header.stripes * sizeof(DWORD), CACHE_LINE);
+    } else {
+        snapshot.buffers = (BYTE *) malloc(snapshot.bound * header.stripes);
+        snapshot.sizes = (DWORD *) calloc(header.stripes, sizeof(DWORD));
+    }
+    return snapshot;
+}
+
+// The arena space a snapshot of a board needs.
+size_t snapshot_bytes(unsigned int width, unsigned int height, int codec) {
+    struct ARENA arena = measuring_arena();
+    create_snapshot(width, height, codec, &arena);
+    return align_size(arena.used, CACHE_LINE) + CACHE_LINE;
+}
+
+void destroy_snapshot(struct SNAPSHOT * snapshot) {
+    if (snapshot->arena != NULL) return;
+    free(snapshot->buffers);
+    free(snapshot->sizes);
+}
+
+void stripe_bounds(struct LIFE * life, struct SNAPSHOT * snapshot, unsigned int stripe,
+                   unsigned int * row_begin, unsigned int * rows) {
+    *row_begin = stripe * snapshot->header.stripe_rows;
+    *rows = snapshot->header.stripe_rows;
+    if (*row_begin + *rows > life->height) *rows = life->height - *row_begin;
+}
+
+// Returns -1 if the codec fails, then the stripe must not be written.
+int encode_stripe(struct LIFE * life, struct SNAPSHOT * snapshot, unsigned int stripe) {
+    unsigned int row_begin, rows;
+    stripe_bounds(life, snapshot, stripe, &row_begin, &rows);
+    uint64_t * words = life_row(life, life->cells, row_begin);
+    size_t size = (size_t) rows * life->words * sizeof(uint64_t);
+    BYTE * out = snapshot->buffers + (size_t) stripe * snapshot->bound;
+
+    size_t length = size;
+    if (snapshot->header.codec == CODEC_ZRLE) {
+        length = zrle_compress(words, size / sizeof(uint64_t), out);
+#ifdef HAVE_LZ4
+    } else if (snapshot->header.codec == CODEC_LZ4) {
+        int compressed = LZ4_compress_default((const char *) words, (char *) out, (int) size, (int) snapshot->bound);
+        if (compressed <= 0) return -1;
+        length = (size_t) compressed;
+#endif
+#ifdef HAVE_ZSTD
+    } else if (snapshot->header.codec == CODEC_ZSTD) {
+        length = ZSTD_compress(out, snapshot->bound, words, size, 1);
+        if (ZSTD_isError(length)) return -1;
+#endif
+    } else {
+        memcpy(out, words, size);
+    }
+    snapshot->sizes[stripe] = (DWORD) length;
+    return 0;
+}
+
+int decode_stripe(struct LIFE * life, struct SNAPSHOT * snapshot, unsigned int stripe) {
+    unsigned int row_begin, rows;
+    stripe_bounds(life, snapshot, stripe, &row_begin, &rows);
+    uint64_t * words = life_row(life, life->cells, row_begin);
+    size_t size = (size_t) rows * life->words * sizeof(uint64_t);
+    BYTE * in = snapshot->buffers + (size_t) stripe * snapshot->bound;
+    size_t length = snapshot->sizes[stripe];
+
+    if (snapshot->header.codec == CODEC_ZRLE) {
+        if (zrle_decompress(in, length, words, size / sizeof(uint64_t)) != 0) return -1;
+#ifdef HAVE_LZ4
+    } else if (snapshot->header.codec == CODEC_LZ4) {
+        if (LZ4_decompress_safe((const char *) in, (char *) words, (int) length, (int) size) != (int) size) return -1;
+#endif
+#ifdef HAVE_ZSTD
+    } else if (snapshot->header.codec == CODEC_ZSTD) {
+        if (ZSTD_decompress(words, size, in, length) != size) return -1;
+#endif
+    } else if (snapshot->header.codec == CODEC_NONE) {
+        if (length != size) return -1;
+        memcpy(words, in, size);
+    } else {
+        return -1;
+    }
+
+    uint64_t mask = last_word_mask(life->width);
+    for (unsigned int i = 0; i < rows; i++) words[(size_t) (i + 1) * life->words - 1] &= mask;
+    return 0;
+}
+
+void write_snapshot(struct SNAPSHOT * snapshot, FILE * file, unsigned int generation) {
+    snapshot->header.generation = generation;
+    fwrite(&snapshot->header, sizeof(snapshot->header), 1, file);
+    fwrite(snapshot->sizes, sizeof(DWORD), snapshot->header.stripes, file);
+    for (unsigned int stripe = 0; stripe < snapshot->header.stripes; stripe++) {
+        fwrite(snapshot->buffers + (size_t) stripe * snapshot->bound, 1, snapshot->sizes[stripe], file);
+    }
+    fflush(file);
+}
+
+// Reads the header, the stripe table and the compressed stripes. The stripes
+// are decompressed later, by the pool. The table and the stripes are checked
+// against the size of the file before their buffers are allocated.
+int read_snapshot(FILE * file, struct SNAPSHOT * snapshot) {
+    memset(snapshot, 0, sizeof(struct SNAPSHOT));
+    if (fseek(file, 0, SEEK_END) != 0) {
+        fprintf(stderr, "Error: Input file is not seekable\n");
+        return -1;
+    }
+    uint64_t file_size = (uint64_t) ftell(file);
+    rewind(file);
+    struct SNAPSHOT_HEADER header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != SNAPSHOT_MAGIC || header.version != 1) {
+        fprintf(stderr, "Error: Invalid snapshot header\n");
+        return -1;
+    }
+    if (header.width == 0 || header.height == 0 || header.stripe_rows == 0
+        || header.stripes != (header.height + header.stripe_rows - 1) / header.stripe_rows) {
+        fprintf(stderr, "Error: Invalid snapshot dimensions\n");
+        return -1;
+    }
+    if (header.codec != CODEC_NONE && header.codec != CODEC_ZRLE && codec_by_name(codec_name(header.codec)) == -1) {
+        fprintf(stderr, "Error: Snapshot codec \"%s\" is not available in this build\n", codec_name(header.codec));
+        return -1;
+    }
+
+    uint64_t data = sizeof(header) + (uint64_t) header.stripes * sizeof(DWORD);
+    if (data > file_size) {
+        fprintf(stderr, "Error: Truncated snapshot: a table of %u stripes does not fit into %llu bytes\n",
+                header.stripes, (unsigned long long) file_size);
+        return -1;
+    }
+
+    snapshot->header = header;
+    snapshot->bound = codec_bound(header.codec, (size_t) header.stripe_rows * row_words(header.width) * sizeof(uint64_t));
+    snapshot->sizes = (DWORD *) calloc(header.stripes, sizeof(DWORD));
+    if (snapshot->sizes == NULL || fread(snapshot->sizes, sizeof(DWORD), header.stripes, file) != header.stripes) {
+        fprintf(stderr, "Error: Truncated snapshot\n");
+        return -1;
+    }
+    for (unsigned int stripe = 0; stripe < header.stripes; stripe++) {
+        if (snapshot->sizes[stripe] > snapshot->bound) {
+            fprintf(stderr, "Error: Invalid size of snapshot stripe %u\n", stripe);
+            return -1;
+        }
+        data += snapshot->sizes[stripe];
+    }
+    if (data > file_size) {
+        fprintf(stderr, "Error: Truncated snapshot: the stripes do not fit into %llu bytes\n",
+                (unsigned long long) file_size);
+        return -1;
+    }
+
+    snapshot->buffers = (BYTE *) malloc(snapshot->bound * header.stripes);
+    if (snapshot->buffers == NULL) {
+        fprintf(stderr, "Error: Not enough memory for a %u x %u snapshot\n", header.width, header.height);
+        return -1;
+    }
+    for (unsigned int stripe = 0; stripe < header.stripes; stripe++) {
+        if (fread(snapshot->buffers + (size_t) stripe * snapshot->bound, 1, snapshot->sizes[stripe], file)
+            != snapshot->sizes[stripe]) {
+            fprintf(stderr, "Error: Truncated snapshot\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Tiles waiting in a deque are always a contiguous range [top, bottom):
+// the owner pops from the bottom, thieves take half of the range from the top.
+struct DEQUE {
+    pthread_mutex_t lock;
+    unsigned int top;
+    unsigned int bottom;
+};
+
+#define TASK_STEP 0
+#define TASK_TOUCH 1
+#define TASK_SCAN 2
+#define TASK_ENCODE 3
+#define TASK_DECODE 4
+#define TASK_RANDOM 5
+
+struct POOL;
+
+struct WORKER {
+    struct POOL * pool;
+    pthread_t thread;
+    unsigned int id;
+    int cpu;
+    int node;
+    struct DEQUE deque;
+    double busy;
+    double total_busy;
+    double total_idle;
+    unsigned long tiles;
+    unsigned long skipped;
+    unsigned long stolen;
+};
+
+struct POOL {
+    struct LIFE * life;
+    unsigned int threads;
+    int pin_threads;
+    int task;
+    struct PIXEL * source;
+    struct INPUT * input;
+    struct SNAPSHOT * snapshot;
+    atomic_int failed;
+    struct WORKER * workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned int generation;
+    unsigned int running;
+    int shutdown;
+    double total_wall;
+};
+
+int worker_take(struct WORKER * worker, unsigned int * tile) {
+    struct POOL * pool = worker->pool;
+
+    pthread_mutex_lock(&worker->deque.lock);
+    if (worker->deque.top < worker->deque.bottom) {
+        *tile = --worker->deque.bottom;
+        pthread_mutex_unlock(&worker->deque.lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&worker->deque.lock);
+
+    if (pool->task == TASK_TOUCH || pool->task == TASK_RANDOM) return 0;
+
+    for (unsigned int k = 1; k < pool->threads; k++) {
+        struct WORKER * victim = &pool->workers[(worker->id + k) % pool->threads];
+
+        pthread_mutex_lock(&victim->deque.lock);
+        unsigned int remaining = victim->deque.bottom - victim->deque.top;
+        if (remaining == 0) {
+            pthread_mutex_unlock(&victim->deque.lock);
+            continue;
+        }
+        unsigned int half = (remaining + 1) / 2;
+        unsigned int first = victim->deque.top;
+        victim->deque.top += half;
+        pthread_mutex_unlock(&victim->deque.lock);
+
+        pthread_mutex_lock(&worker->deque.lock);
+        worker->deque.top = first + 1;
+        worker->deque.bottom = first + half;
+        pthread_mutex_unlock(&worker->deque.lock);
+
+        worker->stolen += half;
+        *tile = first;
+        return 1;
+    }
+    return 0;
+}
+
+// Pins the worker to the id-th CPU the process is allowed to run on, so that
+// consecutive workers fill one NUMA node before moving to the next.
+void pin_worker(struct WORKER * worker) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+
+    int count = CPU_COUNT(&allowed);
+    if (count == 0) return;
+    int target = (int) (worker->id % (unsigned int) count);
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        if (target-- == 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            return;
+        }
+    }
+}
+
+void * worker_main(void * arg) {
+    struct WORKER * worker = (struct WORKER *) arg;
+    struct POOL * pool = worker->pool;
+    unsigned int generation = 0;
+
+    if (pool->pin_threads) pin_worker(worker);
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == generation && !pool->shutdown) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        // libnuma allocates on every lookup, so the node is only looked up
+        // again when the worker has moved to another CPU.
+        int cpu = sched_getcpu();
+        if (cpu != worker->cpu) worker->node = node_of_cpu(cpu);
+        worker->cpu = cpu;
+
+        struct LIFE * life = pool->life;
+        double begin = now_seconds();
+        unsigned int tile;
+        while (worker_take(worker, &tile)) {
+            if (pool->task == TASK_TOUCH) {
+                touch_tile(life, tile, pool->source);
+                continue;
+            }
+            if (pool->task == TASK_RANDOM) {
+                random_tile(life, tile, pool->input);
+                continue;
+            }
+            if (pool->task == TASK_SCAN) {
+                scan_tile(life, tile);
+                continue;
+            }
+            if (pool->task == TASK_ENCODE) {
+                if (encode_stripe(life, pool->snapshot, tile) != 0) atomic_store(&pool->failed, 1);
+                continue;
+            }
+            if (pool->task == TASK_DECODE) {
+                if (decode_stripe(life, pool->snapshot, tile) != 0) atomic_store(&pool->failed, 1);
+                continue;
+            }
+            if (step_tile(life, tile) == 0) worker->skipped++;
+            worker->tiles++;
+        }
+        worker->busy = now_seconds() - begin;
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void destroy_pool(struct POOL * pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned int i = 0; i < pool->threads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        pthread_mutex_destroy(&pool->workers[i].deque.lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool);
+}
+
+// Returns NULL if the pool or one of its threads cannot be created.
+struct POOL * create_pool(struct LIFE * life, unsigned int threads, int pin_threads) {
+    struct POOL * pool = (struct POOL *) calloc(1, sizeof(struct POOL));
+    if (pool == NULL) return NULL;
+    pool->life = life;
+    pool->threads = threads;
+    pool->pin_threads = pin_threads;
+    pool->workers = (struct WORKER *) calloc(threads, sizeof(struct WORKER));
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // libnuma builds its maps of CPUs and nodes on the first lookup, which
+    // is not thread-safe, so it is done here before the workers look up.
+    node_of_cpu(sched_getcpu());
+    for (unsigned int i = 0; i < threads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        pool->workers[i].cpu = -2;
+        pthread_mutex_init(&pool->workers[i].deque.lock, NULL);
+        if (pthread_create(&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]) != 0) {
+            pthread_mutex_destroy(&pool->workers[i].deque.lock);
+            pool->threads = i;
+            destroy_pool(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+// Runs one task over all tiles (or stripes). Every worker starts with a
+// contiguous band, so an evenly active board needs no stealing at all, and
+// the band a worker touches first is the band it computes in every generation.
+void pool_run(struct POOL * pool, int task, unsigned int tiles) {
+    for (unsigned int i = 0; i < pool->threads; i++) {
+        pool->workers[i].deque.top = (unsigned int) ((unsigned long) tiles * i / pool->threads);
+        pool->workers[i].deque.bottom = (unsigned int) ((unsigned long) tiles * (i + 1) / pool->threads);
+    }
+
+    double begin = now_seconds();
+    pthread_mutex_lock(&pool->lock);
+    pool->running = pool->threads;
+    pool->task = task;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    double wall = now_seconds() - begin;
+    pool->total_wall += wall;
+
+    for (unsigned int i = 0; i < pool->threads; i++) {
+        pool->workers[i].total_busy += pool->workers[i].busy;
+        pool->workers[i].total_idle += wall - pool->workers[i].busy;
+    }
+}
+
+void pool_touch(struct POOL * pool, struct PIXEL * source) {
+    pool->source = source;
+    pool_run(pool, TASK_TOUCH, pool->life->tiles_x * pool->life->tiles_y);
+    pool->source = NULL;
+}
+
+// Fills the board with a random soup. Like pool_touch, every worker fills
+// its own band and nothing is stolen.
+void pool_random(struct POOL * pool, struct INPUT * input) {
+    pool->input = input;
+    pool_run(pool, TASK_RANDOM, pool->life->tiles_x * pool->life->tiles_y);
+    pool->input = NULL;
+}
+
+void pool_step(struct POOL * pool) {
+    pool_run(pool, TASK_STEP, pool->life->tiles_x * pool->life->tiles_y);
+}
+
+// Returns -1 if the codec failed on any stripe.
+int pool_encode(struct POOL * pool, struct SNAPSHOT * snapshot) {
+    pool->snapshot = snapshot;
+    atomic_store(&pool->failed, 0);
+    pool_run(pool, TASK_ENCODE, snapshot->header.stripes);
+    pool->snapshot = NULL;
+    return atomic_load(&pool->failed) ? -1 : 0;
+}
+
+// Decompresses a snapshot into a board that was cleared by pool_touch, and
+// sets the tile flags from the new cells.
+int pool_decode(struct POOL * pool, struct SNAPSHOT * snapshot) {
+    pool->snapshot = snapshot;
+    atomic_store(&pool->failed, 0);
+    pool_run(pool, TASK_DECODE, snapshot->header.stripes);
+    pool->snapshot = NULL;
+    if (atomic_load(&pool->failed)) {
+        fprintf(stderr, "Error: Corrupted snapshot\n");
+        return -1;
+    }
+    pool_run(pool, TASK_SCAN, pool->life->tiles_x * pool->life->tiles_y);
+    return 0;
+}
+
+// Encodes the current board with every available codec and prints the
+// throughput and the size against the packed board and a 24-bit .bmp.
+void snapshot_bench(struct POOL * pool, unsigned int repeats) {
+    struct LIFE * life = pool->life;
+    double packed = (double) life->words * life->height * sizeof(uint64_t);
+    double bmp = 54.0 + (double) life->height * ((3.0 * life->width + 3) / 4 * 4);
+    int codecs[] = {CODEC_NONE, CODEC_ZRLE, CODEC_LZ4, CODEC_ZSTD};
+
+    for (int i = 0; i < 4; i++) {
+        if (codecs[i] > CODEC_ZRLE && codec_by_name(codec_name(codecs[i])) == -1) continue;
+        struct SNAPSHOT snapshot = create_snapshot(life->width, life->height, codecs[i], NULL);
+        double begin = now_seconds();
+        int failed = 0;
+        for (unsigned int r = 0; r < repeats; r++) failed |= pool_encode(pool, &snapshot);
+        double seconds = (now_seconds() - begin) / repeats;
+        if (failed) {
+            printf("%s: compression failed\n", codec_name(codecs[i]));
+            destroy_snapshot(&snapshot);
+            continue;
+        }
+
+        double size = sizeof(snapshot.header) + snapshot.header.stripes * sizeof(DWORD);
+        for (unsigned int stripe = 0; stripe < snapshot.header.stripes; stripe++) size += snapshot.sizes[stripe];
+        printf("%s: %.1f MB/s, %.0f bytes, ratio %.2f to packed, %.2f to bmp\n", codec_name(codecs[i]),
+               packed / seconds / 1e6, size, packed / size, bmp / size);
+        destroy_snapshot(&snapshot);
+    }
+}
+
+void print_pool_stats(struct POOL * pool) {
+    for (unsigned int i = 0; i < pool->threads; i++) {
+        struct WORKER * worker = &pool->workers[i];
+        printf("thread %u: cpu %d, node %d, busy %.3f ms, idle %.3f ms, tiles %lu, skipped %lu, stolen %lu\n",
+               i, worker->cpu, worker->node, worker->total_busy * 1000, worker->total_idle * 1000,
+               worker->tiles, worker->skipped, worker->stolen);
+    }
+
+    // The time and tiles of the workers on a node, and the pages of both
+    // generations the kernel placed on it, so the placement of the bands
+    // can be checked against the nodes of the workers that step them.
+    int nodes = numa_nodes();
+    struct LIFE * life = pool->life;
+    unsigned long * pages = (unsigned long *) calloc((size_t) nodes, sizeof(unsigned long));
+    int placed = pages != NULL && board_pages(life->arena.base, life->board_bytes, pages, nodes) == 0;
+    unsigned long total = 0;
+    for (int node = 0; placed && node < nodes; node++) total += pages[node];
+    for (int node = 0; node < nodes; node++) {
+        unsigned int threads = 0;
+        double busy = 0;
+        unsigned long tiles = 0;
+        for (unsigned int i = 0; i < pool->threads; i++) {
+            if (pool->workers[i].node != node) continue;
+            threads++;
+            busy += pool->workers[i].total_busy;
+            tiles += pool->workers[i].tiles;
+        }
+        if (threads == 0 && (!placed || pages[node] == 0)) continue;
+        printf("node %d: threads %u, busy %.3f ms, tiles %lu", node, threads, busy * 1000, tiles);
+        if (placed) {
+            printf(", board pages %lu (%.1f%%)", pages[node], total > 0 ? 100.0 * pages[node] / total : 0.0);
+        }
+        printf("\n");
+    }
+    free(pages);
+}
+
+#define STATS_CSV 0
+#define STATS_BINARY 1
+
+#pragma pack(push, 1)
+
+struct STATS_RECORD {
+    DWORD generation;
+    uint64_t live;
+    uint64_t births;
+    uint64_t deaths;
+    int32_t min_x;
+    int32_t min_y;
+    int32_t max_x;
+    int32_t max_y;
+};
+
+#pragma pack(pop)
+
+struct STATS_OUTPUT {
+    FILE * file;
+    int format;
+    unsigned int freq;
+    unsigned int height;
+};
+
+// Writes the statistics of every freq-th generation, and of the last one.
+// The board keeps its rows bottom-up like a .bmp file, but the bounding box
+// is written with y counted from the top, like --roi and --offset take it.
+void write_stats(struct STATS_OUTPUT * output, unsigned int generation, struct STATS * stats, int last) {
+    if (output->file == NULL) return;
+    if (generation % output->freq != 0 && !last) return;
+
+    struct STATS_RECORD record = {generation, stats->live, stats->births, stats->deaths, -1, -1, -1, -1};
+    if (stats->live > 0) {
+        record.min_x = (int32_t) stats->min_column;
+        record.min_y = (int32_t) (output->height - 1 - stats->max_row);
+        record.max_x = (int32_t) stats->max_column;
+        record.max_y = (int32_t) (output->height - 1 - stats->min_row);
+    }
+
+    if (output->format == STATS_BINARY) {
+        fwrite(&record, sizeof(record), 1, output->file);
+    } else {
+        fprintf(output->file, "%u,%llu,%llu,%llu,%d,%d,%d,%d\n", record.generation,
+                (unsigned long long) record.live, (unsigned long long) record.births,
+                (unsigned long long) record.deaths, record.min_x, record.min_y, record.max_x, record.max_y);
+    }
+    fflush(output->file);
+}
+
+// Shared between the rank processes of the shm transport. Every rank owns a
+// band of rows and publishes its first and last row of each generation into
+// `edges`, double buffered by generation parity. The statistics reduction
+// uses three slots, so a slot can be cleared two generations after it was
+// last read. A rank that fails sets `aborted`, and the ranks waiting for it
+// give up.
+struct EXCHANGE {
+    unsigned int ranks;
+    unsigned int words;
+    atomic_int aborted;
+    atomic_uint arrived[3];
+    atomic_uint finished;
+    atomic_uint * published;
+    double * compute_time;
+    double * wait_time;
+    struct STATS * stats;
+    uint64_t * edges;
+};
+
+// Lays out the shared region. With a measuring arena it only computes the
+// size, and every array starts on its own cache line.
+struct EXCHANGE * layout_exchange(struct ARENA * arena, unsigned int ranks, unsigned int words) {
+    struct EXCHANGE * exchange = (struct EXCHANGE *) arena_alloc(arena, sizeof(struct EXCHANGE), CACHE_LINE);
+    atomic_uint * published = (atomic_uint *) arena_alloc(arena, ranks * sizeof(atomic_uint), CACHE_LINE);
+    double * compute_time = (double *) arena_alloc(arena, ranks * sizeof(double), CACHE_LINE);
+    double * wait_time = (double *) arena_alloc(arena, ranks * sizeof(double), CACHE_LINE);
+    struct STATS * stats = (struct STATS *) arena_alloc(arena, 3 * ranks * sizeof(struct STATS), CACHE_LINE);
+    uint64_t * edges = (uint64_t *) arena_alloc(arena, (size_t) 2 * ranks * 2 * words * sizeof(uint64_t), CACHE_LINE);
+    if (exchange == NULL) return NULL;
+
+    exchange->published = published;
+    exchange->compute_time = compute_time;
+    exchange->wait_time = wait_time;
+    exchange->stats = stats;
+    exchange->edges = edges;
+    return exchange;
+}
+
+struct EXCHANGE * create_exchange(unsigned int ranks, unsigned int width) {
+    unsigned int words = row_words(width);
+    struct ARENA arena = measuring_arena();
+    layout_exchange(&arena, ranks, words);
+    size_t size = arena.used;
+    BYTE * shared = (BYTE *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) return NULL;
+
+    arena.base = shared;
+    arena.size = size;
+    arena.used = 0;
+    struct EXCHANGE * exchange = layout_exchange(&arena, ranks, words);
+    exchange->ranks = ranks;
+    exchange->words = words;
+    for (int i = 0; i < 3; i++) atomic_init(&exchange->arrived[i], 0);
+    atomic_init(&exchange->aborted, 0);
+    atomic_init(&exchange->finished, 0);
+    for (unsigned int i = 0; i < ranks; i++) atomic_init(&exchange->published[i], 0);
+    return exchange;
+}
+
+uint64_t * exchange_edge(struct EXCHANGE * exchange, unsigned int generation, unsigned int rank, unsigned int bottom) {
+    size_t slot = ((size_t) (generation % 2) * exchange->ranks + rank) * 2 + bottom;
+    return exchange->edges + slot * exchange->words;
+}
+
+// The ranks of the distributed game talk through a transport: the shared
+// memory exchange of processes forked on one host, or MPI, which also places
+// the ranks on several nodes. Every process runs the same code for its rank.
+// The calls that wait for other ranks return -1 once a rank has aborted.
+#define TRANSPORT_SHM 0
+#define TRANSPORT_MPI 1
+
+struct TRANSPORT {
+    unsigned int rank;
+    unsigned int ranks;
+    void * state;
+    void (* halo_send)(struct TRANSPORT * transport, unsigned int generation, uint64_t * first_row,
+                       uint64_t * last_row);
+    int (* halo_receive)(struct TRANSPORT * transport, unsigned int generation, uint64_t * top_ghost,
+                         uint64_t * bottom_ghost);
+    int (* reduce_stats)(struct TRANSPORT * transport, unsigned int generation, struct STATS * stats);
+    void (* write_at)(struct TRANSPORT * transport, void * data, size_t size, long offset);
+    int (* gather_times)(struct TRANSPORT * transport, double compute_time, double wait_time,
+                         double * compute_times, double * wait_times);
+    void (* abort)(struct TRANSPORT * transport);
+    int (* finish)(struct TRANSPORT * transport, int result);
+};
+
+struct SHM_LINK {
+    struct EXCHANGE * exchange;
+    int fd;
+    pid_t * children;
+};
+
+void shm_halo_send(struct TRANSPORT * transport, unsigned int generation, uint64_t * first_row,
+                   uint64_t * last_row) {
+    struct EXCHANGE * exchange = ((struct SHM_LINK *) transport->state)->exchange;
+    memcpy(exchange_edge(exchange, generation, transport->rank, 0), first_row, exchange->words * sizeof(uint64_t));
+    memcpy(exchange_edge(exchange, generation, transport->rank, 1), last_row, exchange->words * sizeof(uint64_t));
+    atomic_store_explicit(&exchange->published[transport->rank], generation, memory_order_release);
+}
+
+int shm_halo_receive(struct TRANSPORT * transport, unsigned int generation, uint64_t * top_ghost,
+                     uint64_t * bottom_ghost) {
+    struct EXCHANGE * exchange = ((struct SHM_LINK *) transport->state)->exchange;
+    unsigned int up = (transport->rank + exchange->ranks - 1) % exchange->ranks;
+    unsigned int down = (transport->rank + 1) % exchange->ranks;
+    while (atomic_load_explicit(&exchange->published[up], memory_order_acquire) < generation
+           || atomic_load_explicit(&exchange->published[down], memory_order_acquire) < generation) {
+        if (atomic_load(&exchange->aborted)) return -1;
+        sched_yield();
+    }
+    memcpy(top_ghost, exchange_edge(exchange, generation, up, 1), exchange->words * sizeof(uint64_t));
+    memcpy(bottom_ghost, exchange_edge(exchange, generation, down, 0), exchange->words * sizeof(uint64_t));
+    return 0;
+}
+
+// Replaces the statistics of a band with those of the whole board once every
+// rank has contributed its own.
+int shm_reduce_stats(struct TRANSPORT * transport, unsigned int generation, struct STATS * stats) {
+    struct EXCHANGE * exchange = ((struct SHM_LINK *) transport->state)->exchange;
+    unsigned int slot = generation % 3;
+    unsigned int stale = (generation + 1) % 3;
+    atomic_store(&exchange->arrived[stale], 0);
+
+    exchange->stats[slot * exchange->ranks + transport->rank] = *stats;
+    atomic_fetch_add(&exchange->arrived[slot], 1);
+    while (atomic_load(&exchange->arrived[slot]) < exchange->ranks) {
+        if (atomic_load(&exchange->aborted)) return -1;
+        sched_yield();
+    }
+
+    *stats = empty_stats();
+    for (unsigned int i = 0; i < exchange->ranks; i++) {
+        merge_stats(stats, &exchange->stats[slot * exchange->ranks + i]);
+    }
+    return 0;
+}
+
+void shm_write_at(struct TRANSPORT * transport, void * data, size_t size, long offset) {
+    pwrite(((struct SHM_LINK *) transport->state)->fd, data, size, offset);
+}
+
+// Rank 0 waits until every rank has left its game.
+int shm_gather_times(struct TRANSPORT * transport, double compute_time, double wait_time,
+                     double * compute_times, double * wait_times) {
+    struct EXCHANGE * exchange = ((struct SHM_LINK *) transport->state)->exchange;
+    exchange->compute_time[transport->rank] = compute_time;
+    exchange->wait_time[transport->rank] = wait_time;
+    atomic_fetch_add(&exchange->finished, 1);
+    if (transport->rank != 0) return 0;
+    while (atomic_load(&exchange->finished) < exchange->ranks) {
+        if (atomic_load(&exchange->aborted)) return -1;
+        sched_yield();
+    }
+    memcpy(compute_times, exchange->compute_time, exchange->ranks * sizeof(double));
+    memcpy(wait_times, exchange->wait_time, exchange->ranks * sizeof(double));
+    return 0;
+}
+
+void shm_abort(struct TRANSPORT * transport) {
+    atomic_store(&((struct SHM_LINK *) transport->state)->exchange->aborted, 1);
+}
+
+// Waits for the ranks forked so far. A rank that failed fails the game.
+int wait_ranks(pid_t * children, unsigned int count) {
+    int result = 0;
+    for (unsigned int rank = 1; rank < count; rank++) {
+        int status;
+        if (waitpid(children[rank], &status, 0) != children[rank] || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+// The forked ranks exit here, rank 0 waits for them.
+int shm_finish(struct TRANSPORT * transport, int result) {
+    struct SHM_LINK * link = (struct SHM_LINK *) transport->state;
+    if (transport->rank != 0) _exit(result != 0);
+    if (wait_ranks(link->children, transport->ranks) != 0) result = -1;
+    close(link->fd);
+    free(link->children);
+    free(link);
+    return result;
+}
+
+// Forks the ranks, every process returns with its own rank.
+int start_shm(struct TRANSPORT * transport, unsigned int ranks, unsigned int width, char * output_filename) {
+    struct EXCHANGE * exchange = create_exchange(ranks, width);
+    if (exchange == NULL) {
+        fprintf(stderr, "Error: Cannot map shared memory for %u ranks\n", ranks);
+        return -1;
+    }
+    int fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open output file \"%s\"\n", output_filename);
+        return -1;
+    }
+    struct SHM_LINK * link = (struct SHM_LINK *) calloc(1, sizeof(struct SHM_LINK));
+    link->exchange = exchange;
+    link->fd = fd;
+    link->children = (pid_t *) calloc(ranks, sizeof(pid_t));
+
+    transport->rank = 0;
+    transport->ranks = ranks;
+    transport->state = link;
+    transport->halo_send = shm_halo_send;
+    transport->halo_receive = shm_halo_receive;
+    transport->reduce_stats = shm_reduce_stats;
+    transport->write_at = shm_write_at;
+    transport->gather_times = shm_gather_times;
+    transport->abort = shm_abort;
+    transport->finish = shm_finish;
+
+    // The ranks forked before a failed fork see the abort and exit.
+    fflush(stdout);
+    for (unsigned int rank = 1; rank < ranks; rank++) {
+        link->children[rank] = fork();
+        if (link->children[rank] == 0) {
+            transport->rank = rank;
+            break;
+        }
+        if (link->children[rank] < 0) {
+            fprintf(stderr, "Error: Cannot fork rank %u\n", rank);
+            shm_abort(transport);
+            wait_ranks(link->children, rank);
+            close(fd);
+            free(link->children);
+            free(link);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#ifdef HAVE_MPI
+// The MPI transport posts the receives of the ghost rows together with the
+// sends of the edge rows, so both travel while the interior rows are computed.
+// A row sent up has tag 0, a row sent down has tag 1, so two ranks that are
+// both each other's neighbours tell the rows apart.
+struct NET_LINK {
+    MPI_File file;
+    MPI_Request requests[4];
+    uint64_t * rows;
+    struct STATS * stats;
+    unsigned int words;
+};
+
+void mpi_halo_send(struct TRANSPORT * transport, unsigned int generation, uint64_t * first_row,
+                   uint64_t * last_row) {
+    (void) generation;
+    struct NET_LINK * link = (struct NET_LINK *) transport->state;
+    unsigned int words = link->words;
+    int up = (int) ((transport->rank + transport->ranks - 1) % transport->ranks);
+    int down = (int) ((transport->rank + 1) % transport->ranks);
+    memcpy(link->rows, first_row, words * sizeof(uint64_t));
+    memcpy(link->rows + words, last_row, words * sizeof(uint64_t));
+    MPI_Irecv(link->rows + 2 * words, (int) words, MPI_UINT64_T, up, 1, MPI_COMM_WORLD, &link->requests[0]);
+    MPI_Irecv(link->rows + 3 * words, (int) words, MPI_UINT64_T, down, 0, MPI_COMM_WORLD, &link->requests[1]);
+    MPI_Isend(link->rows, (int) words, MPI_UINT64_T, up, 0, MPI_COMM_WORLD, &link->requests[2]);
+    MPI_Isend(link->rows + words, (int) words, MPI_UINT64_T, down, 1, MPI_COMM_WORLD, &link->requests[3]);
+}
+
+int mpi_halo_receive(struct TRANSPORT * transport, unsigned int generation, uint64_t * top_ghost,
+                     uint64_t * bottom_ghost) {
+    (void) generation;
+    struct NET_LINK * link = (struct NET_LINK *) transport->state;
+    MPI_Waitall(4, link->requests, MPI_STATUSES_IGNORE);
+    memcpy(top_ghost, link->rows + 2 * link->words, link->words * sizeof(uint64_t));
+    memcpy(bottom_ghost, link->rows + 3 * link->words, link->words * sizeof(uint64_t));
+    return 0;
+}
+
+int mpi_reduce_stats(struct TRANSPORT * transport, unsigned int generation, struct STATS * stats) {
+    (void) generation;
+    struct NET_LINK * link = (struct NET_LINK *) transport->state;
+    MPI_Allgather(stats, sizeof(struct STATS), MPI_BYTE, link->stats, sizeof(struct STATS), MPI_BYTE,
+                  MPI_COMM_WORLD);
+    *stats = empty_stats();
+    for (unsigned int i = 0; i < transport->ranks; i++) merge_stats(stats, &link->stats[i]);
+    return 0;
+}
+
+void mpi_write_at(struct TRANSPORT * transport, void * data, size_t size, long offset) {
+    MPI_File_write_at(((struct NET_LINK *) transport->state)->file, offset, data, (int) size, MPI_BYTE,
+                      MPI_STATUS_IGNORE);
+}
+
+int mpi_gather_times(struct TRANSPORT * transport, double compute_time, double wait_time,
+                     double * compute_times, double * wait_times) {
+    (void) transport;
+    MPI_Gather(&compute_time, 1, MPI_DOUBLE, compute_times, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Gather(&wait_time, 1, MPI_DOUBLE, wait_times, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    return 0;
+}
+
+// MPI stops the ranks that wait for a failed one itself.
+void mpi_abort(struct TRANSPORT * transport) {
+    (void) transport;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+// A game that stops early leaves the edge rows of its last generation in
+// flight, they are completed before MPI is finalized.
+int mpi_finish(struct TRANSPORT * transport, int result) {
+    struct NET_LINK * link = (struct NET_LINK *) transport->state;
+    MPI_Waitall(4, link->requests, MPI_STATUSES_IGNORE);
+    MPI_File_close(&link->file);
+    free(link->rows);
+    free(link->stats);
+    free(link);
+    MPI_Finalize();
+    return result;
+}
+
+// Joins the ranks started by mpirun, the number of ranks is theirs.
+int start_mpi(struct TRANSPORT * transport, unsigned int width, char * output_filename) {
+    int rank, ranks;
+    MPI_Init(NULL, NULL);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    struct NET_LINK * link = (struct NET_LINK *) calloc(1, sizeof(struct NET_LINK));
+    link->words = row_words(width);
+    link->rows = (uint64_t *) calloc(4 * (size_t) link->words, sizeof(uint64_t));
+    link->stats = (struct STATS *) calloc((size_t) ranks, sizeof(struct STATS));
+    for (int i = 0; i < 4; i++) link->requests[i] = MPI_REQUEST_NULL;
+    if (MPI_File_open(MPI_COMM_WORLD, output_filename, MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL,
+                      &link->file) != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "Error: Cannot open output file \"%s\"\n", output_filename);
+        MPI_Finalize();
+        return -1;
+    }
+    MPI_File_set_size(link->file, 0);
+
+    transport->rank = (unsigned int) rank;
+    transport->ranks = (unsigned int) ranks;
+    transport->state = link;
+    transport->halo_send = mpi_halo_send;
+    transport->halo_receive = mpi_halo_receive;
+    transport->reduce_stats = mpi_reduce_stats;
+    transport->write_at = mpi_write_at;
+    transport->gather_times = mpi_gather_times;
+    transport->abort = mpi_abort;
+    transport->finish = mpi_finish;
+    return 0;
+}
+#endif
+
+// Computes rows [row_begin, row_end) of a band stored with one ghost row above
+// and one below it. Columns wrap around, rows never do.
+void step_rows(uint64_t * cells, uint64_t * new_cells, unsigned int width, unsigned int row_begin,
+               unsigned int row_end, unsigned int first_row, struct STATS * stats, int count) {
+    unsigned int words = row_words(width);
+    for (unsigned int i = row_begin; i < row_end; i++) {
+        step_words(cells + (size_t) (i - 1) * words, cells + (size_t) i * words, cells + (size_t) (i + 1) * words,
+                   new_cells + (size_t) i * words, 0, words, width, first_row + i - 1, stats, count, 0);
+    }
+}
+
+void write_bmp_rows(struct TRANSPORT * transport, struct BMP * bmp, unsigned int row_begin, uint64_t * cells,
+                    unsigned int rows, struct PIXEL * pixels) {
+    unsigned int width = (unsigned int) bmp->bitmapinfo.biWidth;
+    long mul = 3 * (long) width;
+    long dif = 0;
+    if (mul % 4 != 0) dif = 4 - mul % 4;
+    long start = (long) (sizeof(bmp->bitmapfileheader) + sizeof(bmp->bitmapinfo));
+
+    for (unsigned int i = 0; i < rows; i++) {
+        unpack_row(cells + (size_t) i * row_words(width), width, pixels);
+        transport->write_at(transport, pixels, (size_t) mul, start + (row_begin + i) * (mul + dif));
+    }
+}
+
+// Places the part of the input pattern (or random soup) that falls into a
+// band and its two ghost rows. With few rows per rank a board row can appear
+// twice.
+void place_pattern_rows(struct INPUT * input, unsigned int row_begin, unsigned int rows, uint64_t * cells) {
+    unsigned int width = input->width;
+    unsigned int height = input->height;
+    unsigned int words = row_words(width);
+    if (input->format == FORMAT_RANDOM) {
+        for (unsigned int i = 0; i < rows + 2; i++) {
+            random_words(input, (row_begin + height + i - 1) % height, 0, words, cells + (size_t) i * words);
+        }
+        return;
+    }
+    for (unsigned int r = 0; r < input->pattern.runs; r++) {
+        struct RUN run = input->pattern.data[r];
+        unsigned int row = height - 1 - (input->offset_y + run.y) % height;
+        for (unsigned int i = (row + height + 1 - row_begin) % height; i < rows + 2; i += height) {
+            for (unsigned int j = 0; j < run.length && j < width; j++) {
+                unsigned int x = (input->offset_x + run.x + j) % width;
+                cells[(size_t) i * words + x / 64] |= 1ULL << (x % 64);
+            }
+        }
+    }
+}
+
+// Runs one rank of the distributed game. The band is computed edges first:
+// as soon as the first and last row are published the neighbours can go on,
+// while this rank is still busy with its interior rows. A rank that fails
+// aborts the others. Every rank counts the statistics when they are written,
+// only rank 0 writes them.
+int run_rank(struct TRANSPORT * transport, struct INPUT * input, struct BMP * bmp, int max_iter, int dump_freq,
+             struct STATS_OUTPUT * stats_output, int count, int pool_stats) {
+    unsigned int height = (unsigned int) bmp->bitmapinfo.biHeight;
+    unsigned int width = (unsigned int) bmp->bitmapinfo.biWidth;
+    unsigned int words = row_words(width);
+    unsigned int rank = transport->rank;
+    unsigned int ranks = transport->ranks;
+    unsigned int row_begin = (unsigned int) ((unsigned long) height * rank / ranks);
+    unsigned int rows = (unsigned int) ((unsigned long) height * (rank + 1) / ranks) - row_begin;
+
+    // The band, its ghost rows and the row buffer come from one arena.
+    size_t band = (size_t) (rows + 2) * words * sizeof(uint64_t);
+    struct ARENA arena;
+    if (create_arena(&arena, 2 * align_size(band, ARENA_PAGE) + (size_t) width * 3, NUMA_FIRST_TOUCH) != 0) {
+        fprintf(stderr, "Error: Not enough memory for rank %u\n", rank);
+        transport->abort(transport);
+        return -1;
+    }
+    uint64_t * cells = (uint64_t *) arena_alloc(&arena, band, ARENA_PAGE);
+    uint64_t * new_cells = (uint64_t *) arena_alloc(&arena, band, ARENA_PAGE);
+    struct PIXEL * pixels = (struct PIXEL *) arena_alloc(&arena, (size_t) width * 3, ARENA_PAGE);
+
+    if (input->format == FORMAT_BMP) {
+        FILE * infile = fopen(input->filename, "r");
+        int result = infile == NULL ? -1 : 0;
+        for (unsigned int i = 0; result == 0 && i < rows + 2; i++) {
+            result = read_bmp_row(infile, bmp, (long) ((row_begin + height + i - 1) % height), pixels);
+            pack_row(pixels, width, cells + (size_t) i * words);
+        }
+        if (infile != NULL) fclose(infile);
+        if (result != 0) {
+            fprintf(stderr, "Error: Rank %u cannot read input file \"%s\"\n", rank, input->filename);
+            transport->abort(transport);
+            destroy_arena(&arena);
+            return -1;
+        }
+    } else {
+        place_pattern_rows(input, row_begin, rows, cells);
+    }
+
+    struct STATS stats = empty_stats();
+    for (unsigned int i = 1; i <= rows; i++) {
+        for (unsigned int k = 0; k < words; k++) {
+            count_word(&stats, 0, cells[(size_t) i * words + k], k, row_begin + i - 1, 1);
+        }
+    }
+    stats.births = 0;
+    stats.diff = 0;
+
+    int result = transport->reduce_stats(transport, 0, &stats);
+    if (rank == 0 && result == 0) write_stats(stats_output, 0, &stats, 0);
+
+    double compute_time = 0;
+    double wait_time = 0;
+
+    for (unsigned int time = 0; result == 0 && time < max_iter; time++) {
+        if (rank == 0) {
+            sleep(dump_freq);
+            printf("time: %d ", time);
+            fflush(stdout);
+        }
+
+        double begin = now_seconds();
+        stats = empty_stats();
+        step_rows(cells, new_cells, width, 1, 2, row_begin, &stats, count);
+        if (rows > 1) step_rows(cells, new_cells, width, rows, rows + 1, row_begin, &stats, count);
+        transport->halo_send(transport, time + 1, new_cells + words, new_cells + (size_t) rows * words);
+        if (rows > 2) step_rows(cells, new_cells, width, 2, rows, row_begin, &stats, count);
+
+        uint64_t * swap = cells;
+        cells = new_cells;
+        new_cells = swap;
+
+        if (rank == 0) {
+            transport->write_at(transport, &bmp->bitmapfileheader, sizeof(bmp->bitmapfileheader), 0);
+            transport->write_at(transport, &bmp->bitmapinfo, sizeof(bmp->bitmapinfo), sizeof(bmp->bitmapfileheader));
+        }
+        write_bmp_rows(transport, bmp, row_begin, cells + words, rows, pixels);
+        double computed = now_seconds();
+        compute_time += computed - begin;
+
+        result = transport->reduce_stats(transport, time + 1, &stats);
+        if (result != 0) break;
+        int stable_flag = stats.diff == 0;
+        int empty_flag = stats.any == 0;
+
+        if (rank == 0) {
+            write_stats(stats_output, time + 1, &stats, stable_flag || empty_flag || time + 1 == max_iter);
+            printf("written\n");
+            if (stable_flag == 1) printf("The Game of Life is stable");
+            else if (empty_flag == 1) printf("The Game of Life is dead");
+            fflush(stdout);
+        }
+        if (stable_flag == 1 || empty_flag == 1) {
+            wait_time += now_seconds() - computed;
+            break;
+        }
+
+        result = transport->halo_receive(transport, time + 1, cells, cells + (size_t) (rows + 1) * words);
+        wait_time += now_seconds() - computed;
+    }
+
+    destroy_arena(&arena);
+    if (result != 0) return -1;
+    double * compute_times = (double *) calloc(ranks, sizeof(double));
+    double * wait_times = (double *) calloc(ranks, sizeof(double));
+    result = transport->gather_times(transport, compute_time, wait_time, compute_times, wait_times);
+    if (rank == 0 && result == 0 && pool_stats) {
+        printf("\n");
+        for (unsigned int i = 0; i < ranks; i++) {
+            printf("rank %u: compute %.3f ms, wait %.3f ms\n", i, compute_times[i] * 1000, wait_times[i] * 1000);
+        }
+    }
+    free(compute_times);
+    free(wait_times);
+    return result;
+}
+
+int validate_bmp_colors(FILE * file, struct BMP * bmp) {
+    unsigned int height = (unsigned int) bmp->bitmapinfo.biHeight;
+    unsigned int width = (unsigned int) bmp->bitmapinfo.biWidth;
+    struct PIXEL black = pixel(0, 0, 0);
+    struct PIXEL white = pixel(255, 255, 255);
+    struct PIXEL * row = (struct PIXEL *) calloc(width, 3);
+    for (unsigned int i = 0; i < height; i++) {
+        if (read_bmp_row(file, bmp, i, row) != 0) {
+            fprintf(stderr, "Error: Cannot read row %u of the BMP file\n", i);
+            free(row);
+            return -1;
+        }
+        for (unsigned int j = 0; j < width; j++) {
+            struct PIXEL p = row[j];
+            if (eq_pixel(p, black) == 0 && eq_pixel(p, white) == 0) {
+                fprintf(stderr, "Error: Unsupported color {r: %d, g: %d, b: %d}\n", p.r, p.g, p.b);
+                free(row);
+                return -1;
+            }
+        }
+    }
+    free(row);
+    return 0;
+}
+
+// Opens the statistics file, if there is one, and writes the CSV header.
+int open_stats(struct STATS_OUTPUT * output, char * filename, unsigned int height) {
+    output->height = height;
+    if (strcmp(filename, "") == 0) return 0;
+    output->file = fopen(filename, output->format == STATS_BINARY ? "wb" : "w");
+    if (output->file == NULL) {
+        fprintf(stderr, "Error: Cannot open stats file \"%s\"\n", filename);
+        return -1;
+    }
+    if (output->format == STATS_CSV) {
+        fprintf(output->file, "generation,live,births,deaths,min_x,min_y,max_x,max_y\n");
+    }
+    return 0;
+}
+
+// Every rank runs this with its own transport: the whole board only exists
+// in the output file.
+int run_distributed(struct INPUT * input, char * output_filename, int max_iter, int dump_freq, int transport_kind,
+                    unsigned int ranks, int pool_stats, struct STATS_OUTPUT * stats_output, char * stats_filename) {
+    unsigned int height = input->height;
+    unsigned int width = input->width;
+    struct BMP bmp = create_bmp(width, height, NULL);
+
+    struct TRANSPORT transport;
+#ifdef HAVE_MPI
+    if (transport_kind == TRANSPORT_MPI) {
+        if (start_mpi(&transport, width, output_filename) != 0) return -1;
+    } else
+#else
+    (void) transport_kind;
+#endif
+    if (start_shm(&transport, ranks, width, output_filename) != 0) return -1;
+
+    int result = 0;
+    if (transport.ranks > height) {
+        if (transport.rank == 0) {
+            fprintf(stderr, "Error: The number of ranks must not exceed the board height %u\n", height);
+        }
+        result = -1;
+    }
+    if (result == 0 && input->format == FORMAT_BMP) {
+        FILE * infile = fopen(input->filename, "r");
+        if (infile == NULL) {
+            fprintf(stderr, "Error: Cannot open input file \"%s\"\n", input->filename);
+            result = -1;
+        }
+        if (result == 0) result = read_bmp_header(infile, &bmp);
+        if (result == 0 && transport.rank == 0) result = validate_bmp_colors(infile, &bmp);
+        if (infile != NULL) fclose(infile);
+    }
+    if (result == 0 && transport.rank == 0) result = open_stats(stats_output, stats_filename, input->height);
+    if (result != 0) {
+        transport.abort(&transport);
+    } else {
+        result = run_rank(&transport, input, &bmp, max_iter, dump_freq, stats_output,
+                          strcmp(stats_filename, "") != 0, pool_stats);
+    }
+    if (stats_output->file != NULL) fclose(stats_output->file);
+    return transport.finish(&transport, result);
+}
+
+// Reads the input file: a whole .bmp image (or only its headers for the
+// distributed mode), a pattern or a compressed snapshot, and sets the size
+// of the board.
+int read_input(struct INPUT * input, struct BMP * bmp, struct SNAPSHOT * snapshot, unsigned int * generation,
+               int headers_only) {
+    if (input->format == FORMAT_SNAPSHOT) {
+        FILE * infile = fopen(input->filename, "rb");
+        if (infile == NULL) {
+            fprintf(stderr, "Error: Cannot open input file \"%s\"\n", input->filename);
+            return -1;
+        }
+        int result = read_snapshot(infile, snapshot);
+        fclose(infile);
+        if (result != 0) {
+            destroy_snapshot(snapshot);
+            return -1;
+        }
+        input->width = snapshot->header.width;
+        input->height = snapshot->header.height;
+        *generation = (unsigned int) snapshot->header.generation;
+        *bmp = create_bmp(input->width, input->height, NULL);
+    } else if (input->format == FORMAT_BMP) {
+        FILE * infile = fopen(input->filename, "r");
+        if (infile == NULL) {
+            fprintf(stderr, "Error: Cannot open input file \"%s\"\n", input->filename);
+            return -1;
+        }
+        int result = headers_only ? read_bmp_header(infile, bmp) : read_bmp(infile, bmp);
+        fclose(infile);
+        if (result != 0) return -1;
+        input->width = (unsigned int) bmp->bitmapinfo.biWidth;
+        input->height = (unsigned int) bmp->bitmapinfo.biHeight;
+    } else if (input->format == FORMAT_RANDOM) {
+        *bmp = create_bmp(input->width, input->height, NULL);
+    } else {
+        if (read_pattern(input->filename, input->format, &input->pattern) != 0) return -1;
+        if (input->width == 0) {
+            input->width = input->pattern.width > 0 ? input->offset_x + input->pattern.width : 1;
+            input->height = input->pattern.height > 0 ? input->offset_y + input->pattern.height : 1;
+        }
+        *bmp = create_bmp(input->width, input->height, NULL);
+    }
+    return 0;
+}
+
+// Fills the board of the pool with what read_input has read, and frees it.
+int fill_life(struct POOL * pool, struct INPUT * input, struct BMP * bmp, struct SNAPSHOT * snapshot) {
+    struct LIFE * life = pool->life;
+    struct PIXEL black = pixel(0, 0, 0);
+    struct PIXEL white = pixel(255, 255, 255);
+    for (size_t i = 0; bmp->pixelsdata.data != NULL && i < (size_t) life->width * life->height; i++) {
+        struct PIXEL p = bmp->pixelsdata.data[i];
+        if (eq_pixel(p, black) == 0 && eq_pixel(p, white) == 0) {
+            fprintf(stderr, "Error: Unsupported color {r: %d, g: %d, b: %d}\n", p.r, p.g, p.b);
+            free(bmp->pixelsdata.data);
+            bmp->pixelsdata.data = NULL;
+            return -1;
+        }
+    }
+
+    if (input->format == FORMAT_RANDOM) {
+        pool_random(pool, input);
+        return 0;
+    }
+    pool_touch(pool, bmp->pixelsdata.data);
+    free(bmp->pixelsdata.data);
+    bmp->pixelsdata.data = NULL;
+    if (input->format == FORMAT_SNAPSHOT) {
+        int result = pool_decode(pool, snapshot);
+        destroy_snapshot(snapshot);
+        return result;
+    }
+    if (input->format != FORMAT_BMP) {
+        place_pattern(life, &input->pattern, input->offset_x, input->offset_y);
+        free(input->pattern.data);
+        input->pattern.data = NULL;
+    }
+    return 0;
+}
+
+// Writes the board from the start of an open output file, so a file that is
+// rewritten every generation is opened only once. A .bmp file always has the
+// same size, the other formats may shrink and are cut after the new content.
+// Without a pool a snapshot is encoded on the calling thread. If the codec
+// fails, the file keeps its last content and -1 is returned.
+int write_output(struct LIFE * life, struct BMP * bmp, struct SNAPSHOT * snapshot, struct POOL * pool,
+                 FILE * outfile, int output_format, unsigned int generation) {
+    int result = 0;
+    if (output_format == FORMAT_SNAPSHOT && pool != NULL) {
+        result = pool_encode(pool, snapshot);
+    } else if (output_format == FORMAT_SNAPSHOT) {
+        for (unsigned int stripe = 0; result == 0 && stripe < snapshot->header.stripes; stripe++) {
+            result = encode_stripe(life, snapshot, stripe);
+        }
+    }
+    if (result != 0) {
+        fprintf(stderr, "Error: Cannot compress the snapshot of generation %u\n", generation);
+        return -1;
+    }
+
+    rewind(outfile);
+    if (output_format == FORMAT_RLE) write_rle(life, outfile, generation);
+    else if (output_format == FORMAT_CELLS) write_cells(life, outfile, generation);
+    else if (output_format == FORMAT_SNAPSHOT) write_snapshot(snapshot, outfile, generation);
+    else write_life(life, bmp, outfile);
+    if (output_format != FORMAT_BMP && ftruncate(fileno(outfile), ftell(outfile)) != 0) {
+        fprintf(stderr, "Error: Cannot truncate the output file\n");
+    }
+    return 0;
+}
+
+void close_outputs(FILE * outfile, struct REGION * regions, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        if (regions[i].file == outfile) continue;
+        fclose(regions[i].file);
+        free(regions[i].filename);
+    }
+    free(regions);
+    if (outfile != NULL) fclose(outfile);
+}
+
+// With --pipeline the output is written by a thread of its own while the
+// workers compute the next generations. Every generation the game writes is
+// copied into one of PIPELINE_SLOTS slots and written in order, so the files
+// are the same as without the pipeline. The game waits only when the writer
+// still has a generation waiting, that is, when it is more than one write
+// ahead. The writer waits dump_freq seconds after every write, and the game
+// is held back by the full slots, so generations are written as far apart
+// as without the pipeline.
+#define PIPELINE_SLOTS 2
+
+struct PIPELINE {
+    struct LIFE view;
+    uint64_t * cells[PIPELINE_SLOTS];
+    BYTE * tile_alive[PIPELINE_SLOTS];
+    unsigned int generations[PIPELINE_SLOTS];
+    int ready;
+    int writing;
+    int done;
+    int failed;
+    int dump_freq;
+    unsigned long long written;
+    double waited;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_cond_t taken;
+    pthread_t thread;
+    struct BMP * bmp;
+    struct SNAPSHOT * snapshot;
+    FILE * outfile;
+    int output_format;
+    struct REGION * regions;
+    unsigned int region_count;
+    int scale_mode;
+};
+
+size_t pipeline_bytes(unsigned int width, unsigned int height, unsigned int tile_size) {
+    size_t tiles = (size_t) ((row_words(width) + row_words(tile_size) - 1) / row_words(tile_size))
+                   * ((height + tile_size - 1) / tile_size);
+    size_t board = (size_t) row_words(width) * height * sizeof(uint64_t);
+    return PIPELINE_SLOTS * (align_size(board, CACHE_LINE) + align_size(tiles, CACHE_LINE));
+}
+
+void * pipeline_main(void * arg) {
+    struct PIPELINE * pipeline = (struct PIPELINE *) arg;
+    pthread_mutex_lock(&pipeline->lock);
+    for (;;) {
+        while (pipeline->ready < 0 && !pipeline->done) pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        if (pipeline->ready < 0) break;
+        int slot = pipeline->ready;
+        pipeline->ready = -1;
+        pipeline->writing = slot;
+        pthread_cond_signal(&pipeline->taken);
+        pthread_mutex_unlock(&pipeline->lock);
+
+        // The view shares the row buffers of the board, the game does not
+        // write any output while the pipeline runs.
+        pipeline->view.cells = pipeline->cells[slot];
+        pipeline->view.tile_alive = pipeline->tile_alive[slot];
+        if (pipeline->region_count > 0) {
+            write_regions(&pipeline->view, pipeline->regions, pipeline->region_count, pipeline->scale_mode);
+        } else if (write_output(&pipeline->view, pipeline->bmp, pipeline->snapshot, NULL, pipeline->outfile,
+                                pipeline->output_format, pipeline->generations[slot]) != 0) {
+            pipeline->failed = 1;
+        }
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->written++;
+        if (pipeline->dump_freq > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += pipeline->dump_freq;
+            while (!pipeline->done || pipeline->ready >= 0) {
+                if (pthread_cond_timedwait(&pipeline->changed, &pipeline->lock, &deadline) != 0) break;
+            }
+        }
+        pipeline->writing = -1;
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+// Takes the slots from the arena of the board and starts the writer.
+int create_pipeline(struct PIPELINE * pipeline, struct LIFE * life, struct BMP * bmp, struct SNAPSHOT * snapshot,
+                    FILE * outfile, int output_format, struct REGION * regions, unsigned int region_count,
+                    int scale_mode, int dump_freq) {
+    memset(pipeline, 0, sizeof(struct PIPELINE));
+    size_t tiles = (size_t) life->tiles_x * life->tiles_y;
+    for (int i = 0; i < PIPELINE_SLOTS; i++) {
+        pipeline->cells[i] = (uint64_t *) arena_alloc(&life->arena, (size_t) life->words * life->height
+                                                                    * sizeof(uint64_t), CACHE_LINE);
+        pipeline->tile_alive[i] = (BYTE *) arena_alloc(&life->arena, tiles, CACHE_LINE);
+        if (pipeline->cells[i] == NULL || pipeline->tile_alive[i] == NULL) {
+            fprintf(stderr, "Error: Not enough memory for the pipeline\n");
+            return -1;
+        }
+    }
+    pipeline->view = *life;
+    pipeline->ready = -1;
+    pipeline->writing = -1;
+    pipeline->bmp = bmp;
+    pipeline->snapshot = snapshot;
+    pipeline->outfile = outfile;
+    pipeline->output_format = output_format;
+    pipeline->regions = regions;
+    pipeline->region_count = region_count;
+    pipeline->scale_mode = scale_mode;
+    pipeline->dump_freq = dump_freq;
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->changed, NULL);
+    pthread_cond_init(&pipeline->taken, NULL);
+    pthread_create(&pipeline->thread, NULL, pipeline_main, pipeline);
+    return 0;
+}
+
+// Hands a finished generation to the writer. If a generation is still
+// waiting for the writer, the game waits until the writer takes it; then the
+// slot that is not being written is free and is copied without the lock.
+void pipeline_push(struct PIPELINE * pipeline, struct LIFE * life, unsigned int generation) {
+    pthread_mutex_lock(&pipeline->lock);
+    if (pipeline->ready >= 0) {
+        double begin = now_seconds();
+        while (pipeline->ready >= 0) pthread_cond_wait(&pipeline->taken, &pipeline->lock);
+        pipeline->waited += now_seconds() - begin;
+    }
+    int slot = pipeline->writing == 0 ? 1 : 0;
+    pthread_mutex_unlock(&pipeline->lock);
+
+    memcpy(pipeline->cells[slot], life->cells, (size_t) life->words * life->height * sizeof(uint64_t));
+    memcpy(pipeline->tile_alive[slot], life->tile_alive, (size_t) life->tiles_x * life->tiles_y);
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->generations[slot] = generation;
+    pipeline->ready = slot;
+    pthread_cond_signal(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+// Waits until the last generation is written and stops the writer. Returns
+// -1 if any generation could not be written.
+int finish_pipeline(struct PIPELINE * pipeline) {
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->done = 1;
+    pthread_cond_signal(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    pthread_join(pipeline->thread, NULL);
+    pthread_mutex_destroy(&pipeline->lock);
+    pthread_cond_destroy(&pipeline->changed);
+    pthread_cond_destroy(&pipeline->taken);
+    return pipeline->failed ? -1 : 0;
+}
+
+int save_output(struct LIFE * life, struct BMP * bmp, struct SNAPSHOT * snapshot, struct POOL * pool,
+                char * output_filename, int output_format, unsigned int generation) {
+    FILE * outfile = fopen(output_filename, "wb");
+    if (outfile == NULL) {
+        fprintf(stderr, "Error: Cannot open output file \"%s\"\n", output_filename);
+        return -1;
+    }
+    int result = write_output(life, bmp, snapshot, pool, outfile, output_format, generation);
+    fclose(outfile);
+    return result;
+}
+
+// A soup search runs many seeded soups until they settle and counts the
+// objects that are left. Every thread runs whole soups on its own board, so
+// the soups need no synchronisation and the census does not depend on the
+// number of threads. Soup i uses the seed --seed + i.
+//
+// Objects are named by their apgcode: xs<cells> for still lifes,
+// xp<period> for oscillators and xq<period> for spaceships, followed by the
+// extended Wechsler code of the smallest phase in any orientation.
+#define SEARCH_PERIOD 64
+#define OBJECT_SIZE 40
+#define OBJECT_MARGIN (SEARCH_PERIOD / 2 + 4)
+#define OBJECT_GRID (OBJECT_SIZE + 2 * OBJECT_MARGIN)
+#define CODE_LENGTH 512
+
+#define SOUP_DEAD 0
+#define SOUP_STABLE 1
+#define SOUP_PERIODIC 2
+#define SOUP_MOVING 3
+#define SOUP_UNSETTLED 4
+
+char * soup_outcomes[] = {"dead", "stable", "periodic", "moving", "unsettled"};
+
+struct CENSUS_ENTRY {
+    char code[CODE_LENGTH];
+    unsigned long long count;
+    uint64_t seed;
+};
+
+struct CENSUS {
+    struct CENSUS_ENTRY * entries;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned long long outcomes[5];
+    unsigned long long generations;
+};
+
+// A box of cells, from (x0, y0) to (x1, y1) inclusive.
+struct BOX {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+// A small plane on which one object runs on its own, one byte per cell.
+// Only the box around the live cells is computed.
+struct PLANE {
+    BYTE * cells;
+    BYTE * next;
+    struct BOX box;
+};
+
+// The buffers of one search thread all come from the arena of its board.
+// A group is a set of live cells at most two cells apart; object_x and
+// object_y hold its cells, piece the 8-connected piece of every cell, and
+// parent the union-find forest of the pieces.
+struct SEARCHER {
+    struct LIFE life;
+    struct INPUT input;
+    unsigned int max_iter;
+    uint64_t * history;
+    uint64_t * boards;
+    BYTE * marks;
+    int * object_x;
+    int * object_y;
+    int * piece;
+    int * parent;
+    struct PLANE planes[3];
+    BYTE * first;
+    struct CENSUS census;
+    char code[CODE_LENGTH];
+    char candidate[CODE_LENGTH];
+    pthread_t thread;
+    struct SEARCH * search;
+};
+
+struct SEARCH {
+    atomic_ullong next;
+    unsigned long long soups;
+    uint64_t seed;
+};
+
+size_t search_bytes(unsigned int width, unsigned int height) {
+    size_t cells = (size_t) width * height;
+    size_t board = (size_t) row_words(width) * height * sizeof(uint64_t);
+    return SEARCH_PERIOD * (sizeof(uint64_t) + board) + cells + 4 * cells * sizeof(int)
+           + 6 * OBJECT_GRID * OBJECT_GRID + OBJECT_SIZE * OBJECT_SIZE + 14 * CACHE_LINE;
+}
+
+void census_add(struct CENSUS * census, char * code, unsigned long long count, uint64_t seed) {
+    for (unsigned int i = 0; i < census->count; i++) {
+        struct CENSUS_ENTRY * entry = &census->entries[i];
+        if (strcmp(entry->code, code) != 0) continue;
+        entry->count += count;
+        if (seed < entry->seed) entry->seed = seed;
+        return;
+    }
+    if (census->count == census->capacity) {
+        census->capacity = census->capacity == 0 ? 64 : 2 * census->capacity;
+        census->entries = (struct CENSUS_ENTRY *) realloc(census->entries,
+                                                          census->capacity * sizeof(struct CENSUS_ENTRY));
+    }
+    struct CENSUS_ENTRY * entry = &census->entries[census->count++];
+    snprintf(entry->code, CODE_LENGTH, "%s", code);
+    entry->count = count;
+    entry->seed = seed;
+}
+
+void merge_census(struct CENSUS * into, struct CENSUS * from) {
+    for (unsigned int i = 0; i < from->count; i++) {
+        census_add(into, from->entries[i].code, from->entries[i].count, from->entries[i].seed);
+    }
+    for (int i = 0; i < 5; i++) into->outcomes[i] += from->outcomes[i];
+    into->generations += from->generations;
+}
+
+int compare_entries(const void * a, const void * b) {
+    const struct CENSUS_ENTRY * first = (const struct CENSUS_ENTRY *) a;
+    const struct CENSUS_ENTRY * second = (const struct CENSUS_ENTRY *) b;
+    if (first->count != second->count) return first->count > second->count ? -1 : 1;
+    return strcmp(first->code, second->code);
+}
+
+BYTE plane_cell(struct PLANE * plane, int x, int y) {
+    if (x < 0 || y < 0 || x >= OBJECT_GRID || y >= OBJECT_GRID) return 0;
+    return plane->cells[y * OBJECT_GRID + x];
+}
+
+// Puts the cells of the group that belong to piece a or b on an empty plane.
+// A piece of -1 stands for all cells.
+void place_pieces(struct SEARCHER * searcher, struct PLANE * plane, unsigned int count, struct BOX * bounds,
+                  int a, int b) {
+    struct BOX box = {OBJECT_GRID, OBJECT_GRID, -1, -1};
+    for (unsigned int i = 0; i < count; i++) {
+        if (a != -1 && searcher->piece[i] != a && searcher->piece[i] != b) continue;
+        int x = searcher->object_x[i] - bounds->x0 + OBJECT_MARGIN;
+        int y = searcher->object_y[i] - bounds->y0 + OBJECT_MARGIN;
+        plane->cells[y * OBJECT_GRID + x] = 1;
+        if (x < box.x0) box.x0 = x;
+        if (x > box.x1) box.x1 = x;
+        if (y < box.y0) box.y0 = y;
+        if (y > box.y1) box.y1 = y;
+    }
+    plane->box = box;
+}
+
+void clear_plane(struct PLANE * plane) {
+    for (int y = plane->box.y0; y <= plane->box.y1 && plane->box.x1 >= plane->box.x0; y++) {
+        memset(plane->cells + y * OBJECT_GRID + plane->box.x0, 0, plane->box.x1 - plane->box.x0 + 1);
+    }
+    plane->box.x1 = -1;
+}
+
+// Returns 0 if the object has died or would leave the plane.
+int step_plane(struct PLANE * plane) {
+    struct BOX * box = &plane->box;
+    if (box->x1 < 0 || box->x0 < 2 || box->y0 < 2 || box->x1 >= OBJECT_GRID - 2 || box->y1 >= OBJECT_GRID - 2) {
+        return 0;
+    }
+
+    BYTE * cells = plane->cells;
+    struct BOX next = {OBJECT_GRID, OBJECT_GRID, -1, -1};
+    for (int y = box->y0 - 1; y <= box->y1 + 1; y++) {
+        for (int x = box->x0 - 1; x <= box->x1 + 1; x++) {
+            int neighbours = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) neighbours += cells[(y + dy) * OBJECT_GRID + x + dx];
+            }
+            BYTE alive = cells[y * OBJECT_GRID + x];
+            neighbours -= alive;
+            BYTE new_alive = neighbours == 3 || (alive && neighbours == 2);
+            plane->next[y * OBJECT_GRID + x] = new_alive;
+            if (!new_alive) continue;
+            if (x < next.x0) next.x0 = x;
+            if (x > next.x1) next.x1 = x;
+            if (y < next.y0) next.y0 = y;
+            if (y > next.y1) next.y1 = y;
+        }
+    }
+    clear_plane(plane);
+    plane->cells = plane->next;
+    plane->next = cells;
+    plane->box = next;
+    return next.x1 >= 0;
+}
+
+// Returns 1 if the plane holds the first phase, maybe moved.
+int same_as_first(struct SEARCHER * searcher, struct PLANE * plane, struct BOX * first) {
+    struct BOX * box = &plane->box;
+    if (box->x1 - box->x0 != first->x1 - first->x0 || box->y1 - box->y0 != first->y1 - first->y0) return 0;
+    for (int y = 0; y <= box->y1 - box->y0; y++) {
+        if (memcmp(plane->cells + (box->y0 + y) * OBJECT_GRID + box->x0, searcher->first + y * OBJECT_SIZE,
+                   box->x1 - box->x0 + 1) != 0) return 0;
+    }
+    return 1;
+}
+
+// Runs pieces a and b together and each on its own plane. They interact if
+// the cells of the pair ever differ from the cells of the two pieces.
+int pieces_interact(struct SEARCHER * searcher, unsigned int count, struct BOX * bounds, int a, int b) {
+    struct PLANE * pair = &searcher->planes[0];
+    struct PLANE * first = &searcher->planes[1];
+    struct PLANE * second = &searcher->planes[2];
+    place_pieces(searcher, pair, count, bounds, a, b);
+    place_pieces(searcher, first, count, bounds, a, a);
+    place_pieces(searcher, second, count, bounds, b, b);
+
+    int interact = 0;
+    for (int t = 1; t <= SEARCH_PERIOD / 2 && !interact; t++) {
+        int steps = step_plane(pair);
+        steps += step_plane(first);
+        steps += step_plane(second);
+        if (steps != 3) {
+            interact = pair->box.x1 >= 0 || first->box.x1 >= 0 || second->box.x1 >= 0;
+            break;
+        }
+        struct BOX box = pair->box;
+        for (int i = 1; i < 3; i++) {
+            struct BOX * other = &searcher->planes[i].box;
+            if (other->x0 < box.x0) box.x0 = other->x0;
+            if (other->x1 > box.x1) box.x1 = other->x1;
+            if (other->y0 < box.y0) box.y0 = other->y0;
+            if (other->y1 > box.y1) box.y1 = other->y1;
+        }
+        for (int y = box.y0; y <= box.y1 && !interact; y++) {
+            for (int x = box.x0; x <= box.x1; x++) {
+                if (plane_cell(pair, x, y) != (plane_cell(first, x, y) | plane_cell(second, x, y))) {
+                    interact = 1;
+                    break;
+                }
+            }
+        }
+    }
+    clear_plane(pair);
+    clear_plane(first);
+    clear_plane(second);
+    return interact;
+}
+
+// Writes one orientation of a phase in extended Wechsler format: strips of
+// five rows, one character per column, runs of empty columns shortened.
+void wechsler(struct PLANE * plane, int length, int breadth, int ox, int oy, int a, int b, int c, int d, char * out) {
+    const char * chars = "0123456789abcdefghijklmnopqrstuvwxyz";
+    size_t n = 0;
+    for (int v = 0; v <= (breadth - 1) / 5; v++) {
+        int zeroes = 0;
+        if (v != 0) out[n++] = 'z';
+        for (int u = 0; u < length; u++) {
+            int baudot = 0;
+            for (int w = 0; w < 5; w++) {
+                baudot = (baudot >> 1) + 16 * plane_cell(plane, ox + a * u + b * (5 * v + w),
+                                                         oy + c * u + d * (5 * v + w));
+            }
+            if (baudot == 0) {
+                zeroes++;
+                continue;
+            }
+            if (zeroes == 1) out[n++] = '0';
+            else if (zeroes == 2) out[n++] = 'w';
+            else if (zeroes == 3) out[n++] = 'x';
+            else if (zeroes > 3) {
+                out[n++] = 'y';
+                out[n++] = chars[zeroes - 4];
+            }
+            zeroes = 0;
+            out[n++] = chars[baudot];
+        }
+    }
+    out[n] = '\0';
+}
+
+// Keeps the shorter of two codes, or the first in alphabetical order.
+void keep_smaller(char * code, char * candidate) {
+    size_t code_length = strlen(code);
+    size_t candidate_length = strlen(candidate);
+    if (code_length == 0 || candidate_length < code_length
+        || (candidate_length == code_length && strcmp(candidate, code) < 0)) {
+        strcpy(code, candidate);
+    }
+}
+
+void canonise_phase(struct SEARCHER * searcher, struct PLANE * plane, char * code) {
+    struct BOX * box = &plane->box;
+    int w = box->x1 - box->x0 + 1;
+    int h = box->y1 - box->y0 + 1;
+    if (w > OBJECT_SIZE || h > OBJECT_SIZE) return;
+    int transforms[8][6] = {
+            {w, h, 1, 0, 0, 1}, {w, h, -1, 0, 0, 1}, {w, h, 1, 0, 0, -1}, {w, h, -1, 0, 0, -1},
+            {h, w, 0, 1, 1, 0}, {h, w, 0, -1, 1, 0}, {h, w, 0, 1, -1, 0}, {h, w, 0, -1, -1, 0}
+    };
+    for (int i = 0; i < 8; i++) {
+        int * t = transforms[i];
+        int ox = t[2] + t[3] < 0 ? box->x1 : box->x0;
+        int oy = t[4] + t[5] < 0 ? box->y1 : box->y0;
+        wechsler(plane, t[0], t[1], ox, oy, t[2], t[3], t[4], t[5], searcher->candidate);
+        keep_smaller(code, searcher->candidate);
+    }
+}
+
+// Names the object made of piece `label` of the group by its apgcode.
+// Returns 0 and leaves the code empty if the object does not repeat within
+// SEARCH_PERIOD generations. Sets *moving for a spaceship.
+int classify_object(struct SEARCHER * searcher, unsigned int count, struct BOX * bounds, int label, int * moving) {
+    struct PLANE * plane = &searcher->planes[0];
+    searcher->code[0] = '\0';
+
+    place_pieces(searcher, plane, count, bounds, label, label);
+    struct BOX first = plane->box;
+    unsigned int population = 0;
+    for (int y = first.y0; y <= first.y1; y++) {
+        memcpy(searcher->first + (y - first.y0) * OBJECT_SIZE, plane->cells + y * OBJECT_GRID + first.x0,
+               first.x1 - first.x0 + 1);
+        for (int x = first.x0; x <= first.x1; x++) population += plane->cells[y * OBJECT_GRID + x];
+    }
+    int period = 0;
+    for (int t = 1; t <= SEARCH_PERIOD && step_plane(plane); t++) {
+        if (same_as_first(searcher, plane, &first)) {
+            period = t;
+            break;
+        }
+    }
+    int moved = plane->box.x0 != first.x0 || plane->box.y0 != first.y0;
+    clear_plane(plane);
+    if (period == 0) return 0;
+
+    char phases[CODE_LENGTH] = "";
+    place_pieces(searcher, plane, count, bounds, label, label);
+    for (int t = 0; t < period; t++) {
+        canonise_phase(searcher, plane, phases);
+        step_plane(plane);
+    }
+    clear_plane(plane);
+    if (phases[0] == '\0') return 0;
+    if (period == 1) snprintf(searcher->code, CODE_LENGTH, "xs%u_%s", population, phases);
+    else snprintf(searcher->code, CODE_LENGTH, "x%c%d_%s", moved ? 'q' : 'p', period, phases);
+    *moving |= moved;
+    return 1;
+}
+
+int find_piece(int * parent, int piece) {
+    while (parent[piece] != piece) piece = parent[piece] = parent[parent[piece]];
+    return piece;
+}
+
+int cells_near(struct SEARCHER * searcher, unsigned int i, unsigned int j, int distance) {
+    return abs(searcher->object_x[i] - searcher->object_x[j]) <= distance
+           && abs(searcher->object_y[i] - searcher->object_y[j]) <= distance;
+}
+
+// Splits a group into its 8-connected pieces, then joins the pieces that
+// interact, so that e.g. two blinkers side by side are two objects while the
+// halves of an aircraft carrier stay one. Leaves the object of every cell in
+// piece and returns the number of pieces.
+int split_group(struct SEARCHER * searcher, unsigned int count, struct BOX * bounds) {
+    int * piece = searcher->piece;
+    int * parent = searcher->parent;
+    int pieces = 0;
+    for (unsigned int i = 0; i < count; i++) piece[i] = -1;
+    for (unsigned int i = 0; i < count; i++) {
+        if (piece[i] != -1) continue;
+        parent[pieces] = pieces;
+        piece[i] = pieces;
+        // The cells of a piece are found by repeated sweeps, groups are small.
+        for (int grown = 1; grown;) {
+            grown = 0;
+            for (unsigned int j = i + 1; j < count; j++) {
+                if (piece[j] != -1) continue;
+                for (unsigned int k = i; k < count; k++) {
+                    if (piece[k] == pieces && cells_near(searcher, j, k, 1)) {
+                        piece[j] = pieces;
+                        grown = 1;
+                        break;
+                    }
+                }
+            }
+        }
+        pieces++;
+    }
+
+    for (int a = 0; a < pieces; a++) {
+        for (int b = a + 1; b < pieces; b++) {
+            if (find_piece(parent, a) == find_piece(parent, b)) continue;
+            int near = 0;
+            for (unsigned int i = 0; i < count && !near; i++) {
+                if (piece[i] != a) continue;
+                for (unsigned int j = 0; j < count && !near; j++) {
+                    near = piece[j] == b && cells_near(searcher, i, j, 2);
+                }
+            }
+            if (near && pieces_interact(searcher, count, bounds, a, b)) {
+                parent[find_piece(parent, a)] = find_piece(parent, b);
+            }
+        }
+    }
+    for (unsigned int i = 0; i < count; i++) piece[i] = find_piece(parent, piece[i]);
+    return pieces;
+}
+
+int board_cell(struct LIFE * life, unsigned int x, unsigned int row) {
+    return (life_row(life, life->cells, row)[x / 64] >> (x % 64)) & 1;
+}
+
+// Separates the board into objects and classifies them. Without `commit`
+// only checks that every object can be classified, and returns 0 at the
+// first one that cannot; with `commit` adds all objects to the census.
+int census_objects(struct SEARCHER * searcher, uint64_t seed, int commit, int * moving) {
+    struct LIFE * life = &searcher->life;
+    int width = (int) life->width;
+    int height = (int) life->height;
+    memset(searcher->marks, 0, (size_t) width * height);
+    *moving = 0;
+
+    for (int row = 0; row < height; row++) {
+        if (!tile_row_alive(life, (unsigned int) row)) continue;
+        for (int column = 0; column < width; column++) {
+            if (searcher->marks[(size_t) row * width + column] || !board_cell(life, column, row)) continue;
+
+            // A breadth-first walk over the live cells at most two cells
+            // apart, across the edges of the board. y counts down, like in
+            // a pattern, so the codes match those of other searches.
+            unsigned int count = 0;
+            searcher->marks[(size_t) row * width + column] = 1;
+            searcher->object_x[count] = column;
+            searcher->object_y[count++] = -row;
+            struct BOX bounds = {column, -row, column, -row};
+            for (unsigned int i = 0; i < count; i++) {
+                for (int dy = -2; dy <= 2; dy++) {
+                    for (int dx = -2; dx <= 2; dx++) {
+                        int x = searcher->object_x[i] + dx;
+                        int y = searcher->object_y[i] + dy;
+                        int wx = ((x % width) + width) % width;
+                        int wy = (((-y) % height) + height) % height;
+                        size_t index = (size_t) wy * width + wx;
+                        if (searcher->marks[index] || !board_cell(life, wx, wy)) continue;
+                        searcher->marks[index] = 1;
+                        searcher->object_x[count] = x;
+                        searcher->object_y[count++] = y;
+                        if (x < bounds.x0) bounds.x0 = x;
+                        if (x > bounds.x1) bounds.x1 = x;
+                        if (y < bounds.y0) bounds.y0 = y;
+                        if (y > bounds.y1) bounds.y1 = y;
+                    }
+                }
+            }
+
+            if (bounds.x1 - bounds.x0 >= OBJECT_SIZE || bounds.y1 - bounds.y0 >= OBJECT_SIZE) {
+                if (!commit) return 0;
+                census_add(&searcher->census, "unclassified", 1, seed);
+                continue;
+            }
+            int pieces = split_group(searcher, count, &bounds);
+            for (int label = 0; label < pieces; label++) {
+                if (searcher->parent[label] != label) continue;
+                int known = classify_object(searcher, count, &bounds, label, moving);
+                if (!known && !commit) return 0;
+                if (commit) census_add(&searcher->census, known ? searcher->code : "unclassified", 1, seed);
+            }
+        }
+    }
+    return 1;
+}
+
+void step_life(struct LIFE * life) {
+    for (unsigned int tile = 0; tile < life->tiles_x * life->tiles_y; tile++) step_tile(life, tile);
+    swap_life(life);
+}
+
+// Runs one soup until it is dead, stable or periodic, or until all its
+// objects repeat on their own (gliders keep a board from repeating).
+int run_soup(struct SEARCHER * searcher, uint64_t seed) {
+    struct LIFE * life = &searcher->life;
+    searcher->input.seed = seed;
+    for (unsigned int tile = 0; tile < life->tiles_x * life->tiles_y; tile++) {
+        random_tile(life, tile, &searcher->input);
+    }
+
+    size_t board = (size_t) life->words * life->height;
+    size_t board_bytes = board * sizeof(uint64_t);
+    int outcome = SOUP_UNSETTLED;
+    int moving = 0;
+    unsigned int time = 0;
+    while (time < searcher->max_iter && outcome == SOUP_UNSETTLED) {
+        step_life(life);
+        struct STATS stats = life_stats(life);
+        if (stats.any == 0) outcome = SOUP_DEAD;
+        else if (stats.diff == 0) outcome = SOUP_STABLE;
+
+        // history[t % SEARCH_PERIOD] holds the hash of generation t + 1 and
+        // boards its cells. A hash that comes back is only a candidate, the
+        // board is compared like in find_cycle before the soup is periodic.
+        uint64_t hash = stats.hash;
+        for (unsigned int p = 2; outcome == SOUP_UNSETTLED && p <= SEARCH_PERIOD && p <= time; p++) {
+            unsigned int slot = (time - p) % SEARCH_PERIOD;
+            if (searcher->history[slot] != hash) continue;
+            if (memcmp(searcher->boards + slot * board, life->cells, board_bytes) == 0) outcome = SOUP_PERIODIC;
+        }
+        searcher->history[time % SEARCH_PERIOD] = hash;
+        memcpy(searcher->boards + (time % SEARCH_PERIOD) * board, life->cells, board_bytes);
+        time++;
+
+        // Objects are only checked at doubling intervals, a soup is rarely
+        // settled before its board repeats.
+        if (outcome == SOUP_UNSETTLED && time >= SEARCH_PERIOD && (time & (time - 1)) == 0
+            && census_objects(searcher, seed, 0, &moving)) {
+            outcome = moving ? SOUP_MOVING : SOUP_PERIODIC;
+        }
+    }
+    searcher->census.generations += time;
+    searcher->census.outcomes[outcome]++;
+    if (outcome != SOUP_DEAD && outcome != SOUP_UNSETTLED) census_objects(searcher, seed, 1, &moving);
+    return outcome;
+}
+
+void * search_main(void * arg) {
+    struct SEARCHER * searcher = (struct SEARCHER *) arg;
+    struct SEARCH * search = searcher->search;
+    for (;;) {
+        unsigned long long i = atomic_fetch_add(&search->next, 1);
+        if (i >= search->soups) return NULL;
+        run_soup(searcher, search->seed + i);
+    }
+}
+
+int create_searcher(struct SEARCHER * searcher, struct INPUT * input, unsigned int tile_size, int numa_policy) {
+    memset(searcher, 0, sizeof(struct SEARCHER));
+    searcher->input = *input;
+    searcher->life = create_life(input->width, input->height, tile_size, numa_policy, 0,
+                                 search_bytes(input->width, input->height));
+    if (searcher->life.cells == NULL) return -1;
+    searcher->life.hash_cells = 1;
+
+    struct ARENA * arena = &searcher->life.arena;
+    size_t cells = (size_t) input->width * input->height;
+    searcher->history = (uint64_t *) arena_alloc(arena, SEARCH_PERIOD * sizeof(uint64_t), CACHE_LINE);
+    searcher->boards = (uint64_t *) arena_alloc(arena, SEARCH_PERIOD * (size_t) searcher->life.words * input->height
+                                                       * sizeof(uint64_t), CACHE_LINE);
+    searcher->marks = (BYTE *) arena_alloc(arena, cells, CACHE_LINE);
+    searcher->object_x = (int *) arena_alloc(arena, cells * sizeof(int), CACHE_LINE);
+    searcher->object_y = (int *) arena_alloc(arena, cells * sizeof(int), CACHE_LINE);
+    searcher->piece = (int *) arena_alloc(arena, cells * sizeof(int), CACHE_LINE);
+    searcher->parent = (int *) arena_alloc(arena, cells * sizeof(int), CACHE_LINE);
+    for (int i = 0; i < 3; i++) {
+        searcher->planes[i].cells = (BYTE *) arena_alloc(arena, OBJECT_GRID * OBJECT_GRID, CACHE_LINE);
+        searcher->planes[i].next = (BYTE *) arena_alloc(arena, OBJECT_GRID * OBJECT_GRID, CACHE_LINE);
+        memset(searcher->planes[i].cells, 0, OBJECT_GRID * OBJECT_GRID);
+        memset(searcher->planes[i].next, 0, OBJECT_GRID * OBJECT_GRID);
+        searcher->planes[i].box.x1 = -1;
+    }
+    searcher->first = (BYTE *) arena_alloc(arena, OBJECT_SIZE * OBJECT_SIZE, CACHE_LINE);
+    return 0;
+}
+
+// Runs `soups` soups of the random input on `threads` threads and prints
+// the outcomes and the census, most common objects first. Every entry
+// names the smallest seed that produced it.
+int run_search(struct INPUT * input, unsigned long long soups, unsigned int max_iter, unsigned int threads,
+               unsigned int tile_size, int numa_policy) {
+    struct SEARCH search;
+    atomic_init(&search.next, 0);
+    search.soups = soups;
+    search.seed = input->seed;
+
+    struct SEARCHER * searchers = (struct SEARCHER *) calloc(threads, sizeof(struct SEARCHER));
+    for (unsigned int i = 0; i < threads; i++) {
+        if (create_searcher(&searchers[i], input, tile_size, numa_policy) != 0) {
+            fprintf(stderr, "Error: Not enough memory for a %u x %u board\n", input->width, input->height);
+            return -1;
+        }
+        searchers[i].max_iter = max_iter;
+        searchers[i].search = &search;
+    }
+
+    double begin = now_seconds();
+    for (unsigned int i = 0; i < threads; i++) pthread_create(&searchers[i].thread, NULL, search_main, &searchers[i]);
+    for (unsigned int i = 0; i < threads; i++) pthread_join(searchers[i].thread, NULL);
+    double seconds = now_seconds() - begin;
+
+    struct CENSUS census;
+    memset(&census, 0, sizeof(census));
+    for (unsigned int i = 0; i < threads; i++) {
+        merge_census(&census, &searchers[i].census);
+        free(searchers[i].census.entries);
+        destroy_life(&searchers[i].life);
+    }
+    free(searchers);
+
+    printf("search: %llu soups of %u x %u, density %g, seeds %llu..%llu\n", soups, input->width, input->height,
+           input->density, (unsigned long long) input->seed, (unsigned long long) (input->seed + soups - 1));
+    printf("search: %.3f s, %.1f soups/s, %.3g generations/s on %u threads\n", seconds,
+           seconds > 0 ? (double) soups / seconds : 0.0,
+           seconds > 0 ? (double) census.generations / seconds : 0.0, threads);
+    printf("outcomes:");
+    for (int i = 0; i < 5; i++) printf(" %s=%llu", soup_outcomes[i], census.outcomes[i]);
+    printf("\n");
+    qsort(census.entries, census.count, sizeof(struct CENSUS_ENTRY), compare_entries);
+    for (unsigned int i = 0; i < census.count; i++) {
+        printf("%s %llu seed=%llu\n", census.entries[i].code, census.entries[i].count,
+               (unsigned long long) census.entries[i].seed);
+    }
+    free(census.entries);
+    return 0;
+}
+
+// An engine computes the next generation of the board of a pool and swaps
+// it in. All engines keep the same board: the packed cells, the tile flags
+// and the tile statistics. So the stable and empty flags, the statistics,
+// cycle detection and every output read the board the same way after any
+// engine. Every engine steps the B3/S23 rule on a torus, the only board
+// there is; the flags tell how an engine runs.
+#define ENGINE_THREADS 1
+
+#define ENGINE_REPEATS 3
+#define ENGINE_CELLS_PER_THREAD (1 << 15)
+#define ENGINE_CHECK 64
+#define ENGINE_LIST_SIZE 2048
+#define ENGINE_LIST_GENERATIONS 10
+
+struct ENGINE {
+    char * name;
+    int flags;
+    void (* step)(struct POOL * pool);
+};
+
+// The naive engine counts the eight neighbours of every cell one by one and
+// steps every tile, quiet or not.
+void naive_tile(struct LIFE * life, unsigned int tile) {
+    unsigned int row_begin, row_end, k_begin, k_end;
+    tile_bounds(life, tile, &row_begin, &row_end, &k_begin, &k_end);
+
+    struct STATS stats = empty_stats();
+    for (unsigned int i = row_begin; i < row_end; i++) {
+        uint64_t * rows[3] = {
+                life_row(life, life->cells, (i + life->height - 1) % life->height),
+                life_row(life, life->cells, i),
+                life_row(life, life->cells, (i + 1) % life->height)
+        };
+        uint64_t * row = rows[1];
+        uint64_t * out = life_row(life, life->new_cells, i);
+        for (unsigned int k = k_begin; k < k_end; k++) {
+            uint64_t word = 0;
+            for (unsigned int j = k * 64; j < life->width && j < k * 64 + 64; j++) {
+                unsigned int columns[3] = {j > 0 ? j - 1 : life->width - 1, j, j + 1 < life->width ? j + 1 : 0};
+                int count = 0;
+                for (int dy = 0; dy < 3; dy++) {
+                    for (int dx = 0; dx < 3; dx++) {
+                        if (dy == 1 && dx == 1) continue;
+                        count += (int) ((rows[dy][columns[dx] / 64] >> (columns[dx] % 64)) & 1);
+                    }
+                }
+                if (count == 3 || (count == 2 && (row[k] >> (j % 64)) & 1)) word |= 1ULL << (j % 64);
+            }
+            out[k] = word;
+            count_word(&stats, row[k], word, k, i, life->count_stats);
+        }
+    }
+    if (life->hash_cells && stats.any != 0) {
+        stats.hash = tile_hash(life, life->new_cells, row_begin, row_end, k_begin, k_end);
+    }
+    life->new_tile_alive[tile] = stats.any != 0;
+    life->new_tile_changed[tile] = stats.diff != 0;
+    life->tile_stats[tile] = stats;
+}
+
+void naive_step(struct POOL * pool) {
+    struct LIFE * life = pool->life;
+    for (unsigned int tile = 0; tile < life->tiles_x * life->tiles_y; tile++) naive_tile(life, tile);
+    swap_life(life);
+}
+
+// The packed engine steps 64 cells at once and skips quiet tiles, on the
+// calling thread.
+void packed_step(struct POOL * pool) {
+    step_life(pool->life);
+}
+
+// The threads engine is the packed engine on the workers of the pool.
+void threads_step(struct POOL * pool) {
+    pool_step(pool);
+    swap_life(pool->life);
+}
+
+struct ENGINE engines[] = {
+        {"naive", 0, naive_step},
+        {"packed", 0, packed_step},
+        {"threads", ENGINE_THREADS, threads_step},
+};
+
+#define ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+// Returns NULL if there is no engine with this name.
+struct ENGINE * engine_by_name(char * name) {
+    for (unsigned int i = 0; i < ENGINES; i++) {
+        if (strcmp(engines[i].name, name) == 0) return &engines[i];
+    }
+    return NULL;
+}
+
+// Picks an engine for a filled board. The packed kernel skips quiet tiles,
+// so the work of a generation is the size of the board times its density,
+// the share of tiles with live cells. The pool only pays off when every
+// thread it wakes gets at least ENGINE_CELLS_PER_THREAD cells of that work,
+// so a small board, or a big one that is mostly empty, is stepped by the
+// packed engine on one thread. The game asks again every ENGINE_CHECK
+// generations, as a pattern may grow from a few tiles to the whole board.
+struct ENGINE * auto_engine(struct LIFE * life, unsigned int threads) {
+    unsigned long long cells = (unsigned long long) life->width * life->height;
+    unsigned long long needed = (unsigned long long) ENGINE_CELLS_PER_THREAD * threads;
+    if (threads < 2 || cells < needed) return engine_by_name("packed");
+
+    unsigned int tiles = life->tiles_x * life->tiles_y;
+    unsigned int live = 0;
+    for (unsigned int tile = 0; tile < tiles; tile++) live += life->tile_alive[tile];
+    if (cells * live / tiles >= needed) return engine_by_name("threads");
+    return engine_by_name("packed");
+}
+
+// Returns the best of ENGINE_REPEATS times of `generations` generations of
+// a random soup, filling the board is not timed, or -1 without memory.
+double time_engine(struct ENGINE * engine, unsigned int threads, unsigned int size, unsigned int generations,
+                   int numa_policy) {
+    struct LIFE life = create_life(size, size, 64, numa_policy, 0, 0);
+    if (life.cells == NULL) return -1;
+    struct POOL * pool = create_pool(&life, threads, 0);
+    if (pool == NULL) {
+        destroy_life(&life);
+        return -1;
+    }
+    struct INPUT input;
+    memset(&input, 0, sizeof(input));
+    input.format = FORMAT_RANDOM;
+    input.width = size;
+    input.height = size;
+    input.density = 0.5;
+    input.seed = 1;
+
+    double best = -1;
+    for (int repeat = 0; repeat < ENGINE_REPEATS; repeat++) {
+        pool_random(pool, &input);
+        double begin = now_seconds();
+        for (unsigned int i = 0; i < generations; i++) engine->step(pool);
+        double seconds = now_seconds() - begin;
+        if (best < 0 || seconds < best) best = seconds;
+    }
+    destroy_pool(pool);
+    destroy_life(&life);
+    return best;
+}
+
+// Prints every engine with its flags and its throughput on a random soup.
+int list_engines(unsigned int threads, int numa_policy) {
+    printf("engines, measured on %u generations of a %u x %u soup, %s step kernel:\n", ENGINE_LIST_GENERATIONS,
+           ENGINE_LIST_SIZE, ENGINE_LIST_SIZE, kernel_level());
+    for (unsigned int i = 0; i < ENGINES; i++) {
+        unsigned int engine_threads = engines[i].flags & ENGINE_THREADS ? threads : 1;
+        double seconds = time_engine(&engines[i], engine_threads, ENGINE_LIST_SIZE, ENGINE_LIST_GENERATIONS,
+                                     numa_policy);
+        if (seconds < 0) {
+            fprintf(stderr, "Error: Not enough memory for a %u x %u board\n", ENGINE_LIST_SIZE, ENGINE_LIST_SIZE);
+            return -1;
+        }
+        printf("%-8s %s%u thread%s, %.3g cells/s\n", engines[i].name,
+               engines[i].flags & ENGINE_THREADS ? "threads, " : "", engine_threads, engine_threads == 1 ? "" : "s",
+               (double) ENGINE_LIST_SIZE * ENGINE_LIST_SIZE * ENGINE_LIST_GENERATIONS / seconds);
+    }
+    return 0;
+}
+
+// The regression harness runs every engine, with every thread count and
+// two tile sizes, on a small corpus, and compares each generation and its
+// statistics with a plain stepper that keeps one byte per cell. Then it
+// times the engines on a random soup and compares their throughput with
+// the median of their last runs in a history file.
+#define REGRESS_WINDOW 5
+#define REGRESS_SIZE 2048
+#define REGRESS_GENERATIONS 25
+
+struct REGRESS_CASE {
+    char * name;
+    char * rle;
+    unsigned int width;
+    unsigned int height;
+    unsigned int offset_x;
+    unsigned int offset_y;
+    double density;
+    unsigned int generations;
+};
+
+// A case without an RLE pattern is a random soup of the given density.
+struct REGRESS_CASE regress_cases[] = {
+        {"glider", "x = 3, y = 3\nbo$2bo$3o!", 40, 30, 0, 0, 0, 200},
+        {"glider across the edges", "x = 3, y = 3\nbo$2bo$3o!", 70, 65, 68, 63, 0, 300},
+        {"block beside a blinker", "x = 3, y = 34\n2o$2o32$3o!", 64, 64, 8, 8, 0, 50},
+        {"gosper gun", "x = 36, y = 9\n24bo$22bobo$12b2o6b2o12b2o$11bo3bo4b2o12b2o$2o8bo5bo3b2o$"
+                       "2o8bo3bob2o4bobo$10bo5bo7bo$11bo3bo$12b2o!", 100, 64, 4, 4, 0, 300},
+        {"r-pentomino", "x = 3, y = 3\nb2o$2o$bo!", 130, 130, 64, 64, 0, 400},
+        {"soup", NULL, 256, 256, 0, 0, 0.5, 300},
+        {"sparse soup", NULL, 200, 150, 0, 0, 0.2, 200},
+        {"odd soup", NULL, 129, 67, 0, 0, 0.4, 200},
+        {"narrow soup", NULL, 3, 100, 0, 0, 0.5, 100},
+};
+
+#define REGRESS_CASES (sizeof(regress_cases) / sizeof(regress_cases[0]))
+
+unsigned int regress_tiles[] = {8, 64};
+
+// An engine and the number of threads of its pool. An engine with threads
+// runs on 1 thread, the powers of two up to --threads and --threads itself,
+// at most one step for each bit of an int and two more.
+#define REGRESS_SWEEP (sizeof(int) * 8 + 2)
+#define REGRESS_STEPPERS (ENGINES * REGRESS_SWEEP)
+
+struct REGRESS_STEPPER {
+    struct ENGINE * engine;
+    unsigned int threads;
+};
+
+// Fills the board of the pool with a case of the corpus.
+int regress_fill(struct POOL * pool, struct REGRESS_CASE * regress_case, uint64_t seed) {
+    struct INPUT input;
+    memset(&input, 0, sizeof(input));
+    input.format = regress_case->rle == NULL ? FORMAT_RANDOM : FORMAT_RLE;
+    input.width = regress_case->width;
+    input.height = regress_case->height;
+    input.offset_x = regress_case->offset_x;
+    input.offset_y = regress_case->offset_y;
+    input.density = regress_case->density;
+    input.seed = seed;
+    if (regress_case->rle != NULL) {
+        FILE * file = fmemopen(regress_case->rle, strlen(regress_case->rle), "r");
+        if (file == NULL) return -1;
+        int result = read_rle(file, &input.pattern);
+        fclose(file);
+        if (result != 0) return -1;
+    }
+
+    struct BMP bmp;
+    memset(&bmp, 0, sizeof(bmp));
+    return fill_life(pool, &input, &bmp, NULL);
+}
+
+// The reference stepper: one byte per cell, the eight neighbours of every
+// cell counted one by one on the torus.
+void reference_step(const BYTE * cells, BYTE * next, unsigned int width, unsigned int height) {
+    for (unsigned int row = 0; row < height; row++) {
+        for (unsigned int x = 0; x < width; x++) {
+            int count = 0;
+            for (unsigned int dy = 0; dy < 3; dy++) {
+                for (unsigned int dx = 0; dx < 3; dx++) {
+                    if (dy == 1 && dx == 1) continue;
+                    unsigned int y = (row + height + dy - 1) % height;
+                    unsigned int j = (x + width + dx - 1) % width;
+                    count += cells[(size_t) y * width + j];
+                }
+            }
+            BYTE alive = cells[(size_t) row * width + x];
+            next[(size_t) row * width + x] = count == 3 || (count == 2 && alive);
+        }
+    }
+}
+
+// The statistics of a step of the reference stepper, with the hash packed
+// from its bytes the way tile_hash reads the words of a board.
+struct STATS reference_stats(const BYTE * old, const BYTE * cells, unsigned int width, unsigned int height) {
+    struct STATS stats = empty_stats();
+    unsigned int words = row_words(width);
+    for (unsigned int row = 0; row < height; row++) {
+        for (unsigned int k = 0; k < words; k++) {
+            uint64_t old_word = 0;
+            uint64_t new_word = 0;
+            for (unsigned int j = k * 64; j < width && j < k * 64 + 64; j++) {
+                old_word |= (uint64_t) old[(size_t) row * width + j] << (j % 64);
+                new_word |= (uint64_t) cells[(size_t) row * width + j] << (j % 64);
+            }
+            count_word(&stats, old_word, new_word, k, row, 1);
+            if (new_word != 0) stats.hash ^= splitmix64(new_word, (uint64_t) row * words + k);
+        }
+    }
+    return stats;
+}
+
+// Returns 0 if the board and its statistics are those of the reference,
+// otherwise describes the first difference.
+int regress_compare(struct LIFE * life, const BYTE * cells, struct STATS * expected, char * reason, size_t size) {
+    for (unsigned int row = 0; row < life->height; row++) {
+        for (unsigned int x = 0; x < life->width; x++) {
+            if (board_cell(life, x, row) != cells[(size_t) row * life->width + x]) {
+                snprintf(reason, size, "cell %u of board row %u", x, row);
+                return -1;
+            }
+        }
+    }
+
+    struct STATS stats = life_stats(life);
+    if ((stats.diff == 0) != (expected->diff == 0) || (stats.any == 0) != (expected->any == 0)) {
+        snprintf(reason, size, "stable or empty flag");
+        return -1;
+    }
+    if (stats.live != expected->live || stats.births != expected->births || stats.deaths != expected->deaths) {
+        snprintf(reason, size, "live %llu, births %llu, deaths %llu instead of %llu, %llu, %llu", stats.live,
+                 stats.births, stats.deaths, expected->live, expected->births, expected->deaths);
+        return -1;
+    }
+    if (stats.live > 0 && (stats.min_row != expected->min_row || stats.max_row != expected->max_row
+                           || stats.min_column != expected->min_column || stats.max_column != expected->max_column)) {
+        snprintf(reason, size, "bounding box");
+        return -1;
+    }
+    if (stats.hash != expected->hash) {
+        snprintf(reason, size, "hash %016llx instead of %016llx", (unsigned long long) stats.hash,
+                 (unsigned long long) expected->hash);
+        return -1;
+    }
+    return 0;
+}
+
+// Runs one case of the corpus with every stepper and tile size side by
+// side, and compares every board with the reference stepper after every
+// generation. A board that differs is not stepped any more.
+int regress_case(struct REGRESS_CASE * regress_case, uint64_t seed, struct REGRESS_STEPPER * steppers,
+                 unsigned int stepper_count, int numa_policy) {
+    unsigned int width = regress_case->width;
+    unsigned int height = regress_case->height;
+    unsigned int tile_count = sizeof(regress_tiles) / sizeof(regress_tiles[0]);
+    unsigned int boards = stepper_count * tile_count;
+    struct LIFE * lifes = (struct LIFE *) calloc(boards, sizeof(struct LIFE));
+    struct POOL ** pools = (struct POOL **) calloc(boards, sizeof(struct POOL *));
+    int * failed = (int *) calloc(boards, sizeof(int));
+
+    int result = 0;
+    unsigned int created = 0;
+    for (; result == 0 && created < boards; created++) {
+        lifes[created] = create_life(width, height, regress_tiles[created % tile_count], numa_policy, 1, 0);
+        if (lifes[created].cells == NULL) {
+            fprintf(stderr, "Error: Not enough memory for a %u x %u board\n", width, height);
+            result = -1;
+            break;
+        }
+        lifes[created].hash_cells = 1;
+        pools[created] = create_pool(&lifes[created], steppers[created / tile_count].threads, 0);
+        result = regress_fill(pools[created], regress_case, seed);
+    }
+
+    BYTE * cells = (BYTE *) malloc((size_t) width * height);
+    BYTE * next = (BYTE *) malloc((size_t) width * height);
+    for (unsigned int row = 0; result == 0 && row < height; row++) {
+        for (unsigned int x = 0; x < width; x++) cells[(size_t) row * width + x] = (BYTE) board_cell(&lifes[0], x, row);
+    }
+
+    char reason[128];
+    for (unsigned int generation = 1; result == 0 && generation <= regress_case->generations; generation++) {
+        reference_step(cells, next, width, height);
+        struct STATS expected = reference_stats(cells, next, width, height);
+        BYTE * swap = cells;
+        cells = next;
+        next = swap;
+
+        for (unsigned int b = 0; b < boards; b++) {
+            if (failed[b]) continue;
+            struct REGRESS_STEPPER * stepper = &steppers[b / tile_count];
+            stepper->engine->step(pools[b]);
+            if (regress_compare(&lifes[b], cells, &expected, reason, sizeof(reason)) != 0) {
+                fprintf(stderr, "Error: %s with %s (%u threads, tile size %u) differs from the reference "
+                                "at generation %u: %s\n", regress_case->name, stepper->engine->name,
+                        stepper->threads, regress_tiles[b % tile_count], generation, reason);
+                failed[b] = 1;
+            }
+        }
+    }
+    for (unsigned int b = 0; b < boards; b++) {
+        if (failed[b]) result = -1;
+    }
+
+    free(cells);
+    free(next);
+    for (unsigned int b = 0; b < created; b++) {
+        if (pools[b] != NULL) destroy_pool(pools[b]);
+        destroy_life(&lifes[b]);
+    }
+    free(failed);
+    free(pools);
+    free(lifes);
+    return result;
+}
+
+int compare_doubles(const void * a, const void * b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// The median throughput of the last REGRESS_WINDOW runs of a stepper on the
+// same workload in the history file, 0 if there are none.
+double regress_baseline(FILE * history, struct REGRESS_STEPPER * stepper) {
+    double window[REGRESS_WINDOW];
+    unsigned int runs = 0;
+    char line[256];
+    rewind(history);
+    while (fgets(line, sizeof(line), history) != NULL) {
+        char engine[32];
+        unsigned int threads, width, height, generations;
+        double throughput;
+        if (sscanf(line, "%*[^,],%31[^,],%u,%u,%u,%u,%lf", engine, &threads, &width, &height, &generations,
+                   &throughput) != 6) continue;
+        if (strcmp(engine, stepper->engine->name) != 0 || threads != stepper->threads || width != REGRESS_SIZE
+            || height != REGRESS_SIZE || generations != REGRESS_GENERATIONS) continue;
+        window[runs % REGRESS_WINDOW] = throughput;
+        runs++;
+    }
+    if (runs == 0) return 0;
+    unsigned int count = runs < REGRESS_WINDOW ? runs : REGRESS_WINDOW;
+    qsort(window, count, sizeof(double), compare_doubles);
+    return count % 2 == 1 ? window[count / 2] : (window[count / 2 - 1] + window[count / 2]) / 2;
+}
+
+// Checks and times every engine, the engines with threads with 1, 2, 4, ...
+// and `threads` threads. The results are appended to the history file only
+// if every engine is equal to the reference. Returns -1 on a difference or
+// if an engine is more than `threshold` percent slower than its median in
+// the history.
+// Without timing only the boards are compared, and the history file is
+// neither read nor written, so the result does not depend on the load of
+// the machine.
+int run_regress(char * history_filename, double threshold, int timing, unsigned int threads, int numa_policy) {
+    struct REGRESS_STEPPER steppers[REGRESS_STEPPERS];
+    unsigned int stepper_count = 0;
+    for (unsigned int i = 0; i < ENGINES; i++) {
+        steppers[stepper_count].engine = &engines[i];
+        steppers[stepper_count++].threads = 1;
+        if (!(engines[i].flags & ENGINE_THREADS)) continue;
+        for (unsigned int t = 2; t <= threads; t *= 2) {
+            steppers[stepper_count].engine = &engines[i];
+            steppers[stepper_count++].threads = t;
+        }
+        if (steppers[stepper_count - 1].threads != threads) {
+            steppers[stepper_count].engine = &engines[i];
+            steppers[stepper_count++].threads = threads;
+        }
+    }
+
+    FILE * history = timing ? fopen(history_filename, "a+") : NULL;
+    if (timing && history == NULL) {
+        fprintf(stderr, "Error: Cannot open history file \"%s\"\n", history_filename);
+        return -1;
+    }
+
+    int exact = 0;
+    for (unsigned int c = 0; c < REGRESS_CASES; c++) {
+        if (regress_case(&regress_cases[c], c + 1, steppers, stepper_count, numa_policy) != 0) exact = -1;
+    }
+    printf("regress: %u cases with %u engines on up to %u threads and %u tile sizes: %s\n",
+           (unsigned int) REGRESS_CASES, (unsigned int) ENGINES, threads,
+           (unsigned int) (sizeof(regress_tiles) / sizeof(regress_tiles[0])),
+           exact == 0 ? "equal to the reference" : "DIFFERENT from the reference");
+    if (!timing) return exact;
+
+    int result = exact;
+    double throughputs[REGRESS_STEPPERS];
+    for (unsigned int s = 0; s < stepper_count; s++) {
+        double seconds = time_engine(steppers[s].engine, steppers[s].threads, REGRESS_SIZE, REGRESS_GENERATIONS,
+                                     numa_policy);
+        if (seconds < 0) {
+            fprintf(stderr, "Error: Not enough memory for a %u x %u board\n", REGRESS_SIZE, REGRESS_SIZE);
+            fclose(history);
+            return -1;
+        }
+        throughputs[s] = (double) REGRESS_SIZE * REGRESS_SIZE * REGRESS_GENERATIONS / seconds;
+        double baseline = regress_baseline(history, &steppers[s]);
+
+        printf("regress: %s on %u thread%s: %.3g cells/s", steppers[s].engine->name, steppers[s].threads,
+               steppers[s].threads == 1 ? "" : "s", throughputs[s]);
+        if (baseline > 0) {
+            double change = (throughputs[s] / baseline - 1) * 100;
+            printf(", median of the last runs %.3g cells/s, %+.1f%%", baseline, change);
+            if (change < -threshold) {
+                printf(" REGRESSION");
+                result = -1;
+            }
+        }
+        printf("\n");
+    }
+    if (exact == 0 && result != 0) {
+        fprintf(stderr, "Error: Throughput is more than %g%% below the median of the last runs\n", threshold);
+    }
+
+    if (exact == 0) {
+        fseek(history, 0, SEEK_END);
+        if (ftell(history) == 0) fprintf(history, "time,engine,threads,width,height,generations,cells_per_second\n");
+        for (unsigned int s = 0; s < stepper_count; s++) {
+            fprintf(history, "%lld,%s,%u,%u,%u,%u,%.6g\n", (long long) time(NULL), steppers[s].engine->name,
+                    steppers[s].threads, REGRESS_SIZE, REGRESS_SIZE, REGRESS_GENERATIONS, throughputs[s]);
+        }
+    }
+    fclose(history);
+    return result;
+}
+
+// The server keeps one board, its pool and its buffers resident between
+// requests. Commands are text lines on a unix socket, and every reply is one
+// line: "ok key=value ..." or "error <message>", with the time the request
+// took in microseconds. Snapshots are copied into a POSIX shared memory
+// object, the reply tells where to find them.
+#define COMMAND_LOAD 0
+#define COMMAND_STEP 1
+#define COMMAND_STATS 2
+#define COMMAND_SNAPSHOT 3
+#define COMMAND_SAVE 4
+#define COMMANDS 5
+
+#pragma pack(push, 1)
+
+struct SHM_HEADER {
+    DWORD magic;
+    DWORD width;
+    DWORD height;
+    DWORD words;
+    uint64_t generation;
+};
+
+#pragma pack(pop)
+
+#define SHM_MAGIC 0x4D48534C
+
+struct SERVER {
+    struct LIFE life;
+    struct POOL * pool;
+    struct ENGINE * engine;
+    int auto_select;
+    int loaded;
+    unsigned int generation;
+    int stable;
+    int empty;
+    unsigned int threads;
+    unsigned int tile_size;
+    int pin_threads;
+    int numa_policy;
+    int codec;
+    char shm_name[64];
+    int shm_fd;
+    BYTE * shm;
+    size_t shm_size;
+    unsigned long requests[COMMANDS];
+    double total_latency[COMMANDS];
+    double max_latency[COMMANDS];
+};
+
+char * command_names[COMMANDS] = {"load", "step", "stats", "snapshot", "save"};
+
+// Loads a board. The buffers and the tile flags are kept if the new board has
+// the size of the old one, the pool is always kept.
+int server_load(struct SERVER * server, char * filename, char * board, char * reply, size_t size) {
+    struct INPUT input;
+    memset(&input, 0, sizeof(input));
+    input.filename = filename;
+    input.format = pattern_format(filename);
+    if (input.format == -1) {
+        snprintf(reply, size, "error invalid input file name");
+        return -1;
+    }
+    if (board != NULL && (sscanf(board, "%ux%u", &input.width, &input.height) != 2 || input.width == 0 || input.height == 0)) {
+        snprintf(reply, size, "error board size must be <width>x<height>");
+        return -1;
+    }
+
+    struct BMP bmp;
+    struct SNAPSHOT snapshot;
+    unsigned int generation = 0;
+    if (read_input(&input, &bmp, &snapshot, &generation, 0) != 0) {
+        snprintf(reply, size, "error cannot read \"%s\"", filename);
+        return -1;
+    }
+
+    if (server->loaded && (server->life.width != input.width || server->life.height != input.height)) {
+        destroy_life(&server->life);
+        server->loaded = 0;
+    }
+    if (!server->loaded) {
+        server->life = create_life(input.width, input.height, server->tile_size, server->numa_policy, 1, 0);
+        if (server->life.cells == NULL || server->life.new_cells == NULL) {
+            free(bmp.pixelsdata.data);
+            free(input.pattern.data);
+            if (input.format == FORMAT_SNAPSHOT) destroy_snapshot(&snapshot);
+            destroy_life(&server->life);
+            snprintf(reply, size, "error not enough memory for a %u x %u board", input.width, input.height);
+            return -1;
+        }
+        server->loaded = 1;
+    }
+    if (server->pool == NULL) {
+        server->pool = create_pool(&server->life, server->threads, server->pin_threads);
+        if (server->pool == NULL) {
+            free(bmp.pixelsdata.data);
+            free(input.pattern.data);
+            if (input.format == FORMAT_SNAPSHOT) destroy_snapshot(&snapshot);
+            destroy_life(&server->life);
+            server->loaded = 0;
+            snprintf(reply, size, "error cannot start %u threads", server->threads);
+            return -1;
+        }
+    }
+    if (fill_life(server->pool, &input, &bmp, &snapshot) != 0) {
+        destroy_life(&server->life);
+        server->loaded = 0;
+        snprintf(reply, size, "error invalid board in \"%s\"", filename);
+        return -1;
+    }
+
+    struct STATS stats = life_stats(&server->life);
+    server->generation = generation;
+    server->stable = 0;
+    server->empty = stats.any == 0;
+    if (server->auto_select) server->engine = auto_engine(&server->life, server->threads);
+    snprintf(reply, size, "ok width=%u height=%u generation=%u engine=%s", input.width, input.height, generation,
+             server->engine->name);
+    return 0;
+}
+
+// Steps the board. A stable or dead board does not change any more, so the
+// rest of the generations are skipped.
+void server_step(struct SERVER * server, unsigned int generations, char * reply, size_t size) {
+    unsigned int target = server->generation + generations;
+    for (unsigned int time = 0; server->generation < target && !server->stable && !server->empty; time++) {
+        if (server->auto_select && time > 0 && time % ENGINE_CHECK == 0) {
+            server->engine = auto_engine(&server->life, server->threads);
+        }
+        server->engine->step(server->pool);
+        struct STATS stats = life_stats(&server->life);
+        server->stable = stats.diff == 0;
+        server->empty = stats.any == 0;
+        server->generation++;
+    }
+    server->generation = target;
+    snprintf(reply, size, "ok generation=%u stable=%d empty=%d engine=%s", server->generation, server->stable,
+             server->empty, server->engine->name);
+}
+
+void server_stats(struct SERVER * server, char * reply, size_t size) {
+    struct STATS stats = life_stats(&server->life);
+    int live = stats.live > 0;
+    int top = (int) server->life.height - 1;
+    snprintf(reply, size, "ok generation=%u live=%llu births=%llu deaths=%llu min_x=%d min_y=%d max_x=%d max_y=%d",
+             server->generation, stats.live, stats.births, stats.deaths,
+             live ? (int) stats.min_column : -1, live ? top - (int) stats.max_row : -1,
+             live ? (int) stats.max_column : -1, live ? top - (int) stats.min_row : -1);
+}
+
+// Copies the packed board into the shared memory object, which grows with
+// the board. A reader maps it and finds a SHM_HEADER followed by the rows.
+int server_snapshot(struct SERVER * server, char * reply, size_t size) {
+    struct LIFE * life = &server->life;
+    size_t bytes = (size_t) life->words * life->height * sizeof(uint64_t);
+    size_t total = sizeof(struct SHM_HEADER) + bytes;
+    if (total > server->shm_size) {
+        if (server->shm != NULL) munmap(server->shm, server->shm_size);
+        server->shm = NULL;
+        server->shm_size = 0;
+        if (ftruncate(server->shm_fd, (off_t) total) != 0) {
+            snprintf(reply, size, "error cannot resize shared memory");
+            return -1;
+        }
+        void * shm = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, server->shm_fd, 0);
+        if (shm == MAP_FAILED) {
+            snprintf(reply, size, "error cannot map shared memory");
+            return -1;
+        }
+        server->shm = (BYTE *) shm;
+        server->shm_size = total;
+    }
+
+    struct SHM_HEADER header = {SHM_MAGIC, life->width, life->height, life->words, server->generation};
+    memcpy(server->shm, &header, sizeof(header));
+    memcpy(server->shm + sizeof(header), life->cells, bytes);
+    snprintf(reply, size, "ok shm=%s offset=%zu bytes=%zu width=%u height=%u words=%u generation=%u",
+             server->shm_name, sizeof(header), bytes, life->width, life->height, life->words, server->generation);
+    return 0;
+}
+
+int server_save(struct SERVER * server, char * filename, char * reply, size_t size) {
+    int format = pattern_format(filename);
+    if (format == -1) {
+        snprintf(reply, size, "error invalid output file name");
+        return -1;
+    }
+    struct BMP bmp = create_bmp(server->life.width, server->life.height, NULL);
+    struct SNAPSHOT snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    if (format == FORMAT_SNAPSHOT) snapshot = create_snapshot(server->life.width, server->life.height, server->codec, NULL);
+    int result = save_output(&server->life, &bmp, &snapshot, server->pool, filename, format, server->generation);
+    destroy_snapshot(&snapshot);
+    if (result != 0) {
+        snprintf(reply, size, "error cannot write \"%s\"", filename);
+        return -1;
+    }
+    snprintf(reply, size, "ok file=%s generation=%u", filename, server->generation);
+    return 0;
+}
+
+// Runs one command line. Returns 1 if the server should stop.
+int server_command(struct SERVER * server, char * line, char * reply, size_t size) {
+    char * words[3] = {NULL, NULL, NULL};
+    int count = 0;
+    for (char * word = strtok(line, " \t\r\n"); word != NULL && count < 3; word = strtok(NULL, " \t\r\n")) {
+        words[count++] = word;
+    }
+    if (count == 0) {
+        snprintf(reply, size, "error empty command");
+        return 0;
+    }
+    if (strcmp(words[0], "shutdown") == 0) {
+        snprintf(reply, size, "ok");
+        return 1;
+    }
+
+    int command = -1;
+    for (int i = 0; i < COMMANDS; i++) {
+        if (strcmp(words[0], command_names[i]) == 0) command = i;
+    }
+    if (command == -1) {
+        snprintf(reply, size, "error unknown command \"%s\"", words[0]);
+        return 0;
+    }
+    if (command != COMMAND_LOAD && !server->loaded) {
+        snprintf(reply, size, "error no board loaded");
+        return 0;
+    }
+
+    double begin = now_seconds();
+    if (command == COMMAND_LOAD) {
+        if (words[1] == NULL) snprintf(reply, size, "error usage: load <filename> [<width>x<height>]");
+        else server_load(server, words[1], words[2], reply, size);
+    } else if (command == COMMAND_STEP) {
+        int generations = words[1] != NULL ? atoi(words[1]) : 1;
+        if (generations < 1) snprintf(reply, size, "error usage: step <num>");
+        else server_step(server, (unsigned int) generations, reply, size);
+    } else if (command == COMMAND_STATS) {
+        server_stats(server, reply, size);
+    } else if (command == COMMAND_SNAPSHOT) {
+        server_snapshot(server, reply, size);
+    } else {
+        if (words[1] == NULL) snprintf(reply, size, "error usage: save <filename>");
+        else server_save(server, words[1], reply, size);
+    }
+    double latency = now_seconds() - begin;
+
+    server->requests[command]++;
+    server->total_latency[command] += latency;
+    if (latency > server->max_latency[command]) server->max_latency[command] = latency;
+    size_t length = strlen(reply);
+    snprintf(reply + length, size - length, " us=%.0f", latency * 1e6);
+    return 0;
+}
+
+int run_server(char * socket_path, struct SERVER * server) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path \"%s\" is too long\n", socket_path);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (listener < 0 || bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 8) != 0) {
+        fprintf(stderr, "Error: Cannot listen on \"%s\"\n", socket_path);
+        return -1;
+    }
+
+    snprintf(server->shm_name, sizeof(server->shm_name), "/bmp-%d", (int) getpid());
+    server->shm_fd = shm_open(server->shm_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (server->shm_fd < 0) {
+        fprintf(stderr, "Error: Cannot create shared memory \"%s\"\n", server->shm_name);
+        close(listener);
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    printf("serving on %s, snapshots in %s\n", socket_path, server->shm_name);
+    fflush(stdout);
+
+    char line[4096];
+    char reply[4096];
+    int stop = 0;
+    while (!stop) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) continue;
+        FILE * in = fdopen(client, "r");
+        while (!stop && fgets(line, sizeof(line), in) != NULL) {
+            stop = server_command(server, line, reply, sizeof(reply));
+            dprintf(client, "%s\n", reply);
+        }
+        fclose(in);
+    }
+
+    for (int i = 0; i < COMMANDS; i++) {
+        if (server->requests[i] == 0) continue;
+        printf("%s: requests %lu, mean %.1f us, max %.1f us\n", command_names[i], server->requests[i],
+               server->total_latency[i] / server->requests[i] * 1e6, server->max_latency[i] * 1e6);
+    }
+    close(listener);
+    unlink(socket_path);
+    if (server->shm != NULL) munmap(server->shm, server->shm_size);
+    close(server->shm_fd);
+    shm_unlink(server->shm_name);
+    if (server->pool != NULL) destroy_pool(server->pool);
+    if (server->loaded) destroy_life(&server->life);
+    return 0;
+}
+
+// The viewer ring is a POSIX shared memory object with a header and two
+// packed frames. Frame n is written into slot n % 2 and then published by
+// setting the sequence to n + 1, so a reader that copies the latest frame
+// has a whole generation before the writer comes back to its slot. A reader
+// checks that the sequence did not change while it copied. The header takes
+// VIEWER_HEADER_SIZE bytes, a cache line, and the frames start after it.
+#define VIEWER_MAGIC 0x5745494C
+#define VIEWER_HEADER_SIZE 64
+
+struct VIEWER_HEADER {
+    DWORD magic;
+    DWORD width;
+    DWORD height;
+    DWORD words;
+    atomic_ullong sequence;
+    uint64_t generation[2];
+};
+
+struct VIEWER {
+    char * name;
+    struct VIEWER_HEADER * header;
+    size_t frame_size;
+    size_t size;
+};
+
+BYTE * viewer_frame(struct VIEWER * viewer, unsigned int slot) {
+    return (BYTE *) viewer->header + VIEWER_HEADER_SIZE + slot * viewer->frame_size;
+}
+
+int create_viewer(struct VIEWER * viewer, char * name, struct LIFE * life) {
+    viewer->name = name;
+    viewer->frame_size = (size_t) life->words * life->height * sizeof(uint64_t);
+    viewer->size = VIEWER_HEADER_SIZE + 2 * viewer->frame_size;
+    viewer->header = NULL;
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t) viewer->size) != 0) {
+        fprintf(stderr, "Error: Cannot create shared memory \"%s\"\n", name);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    void * memory = mmap(NULL, viewer->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map shared memory \"%s\"\n", name);
+        return -1;
+    }
+
+    viewer->header = (struct VIEWER_HEADER *) memory;
+    viewer->header->width = life->width;
+    viewer->header->height = life->height;
+    viewer->header->words = life->words;
+    atomic_store(&viewer->header->sequence, 0);
+    viewer->header->magic = VIEWER_MAGIC;
+    return 0;
+}
+
+void publish_frame(struct VIEWER * viewer, struct LIFE * life, unsigned int generation) {
+    unsigned long long sequence = atomic_load_explicit(&viewer->header->sequence, memory_order_relaxed);
+    unsigned int slot = (unsigned int) (sequence % 2);
+    memcpy(viewer_frame(viewer, slot), life->cells, viewer->frame_size);
+    viewer->header->generation[slot] = generation;
+    atomic_store_explicit(&viewer->header->sequence, sequence + 1, memory_order_release);
+}
+
+// The object stays after the game ends, so the last frame can still be viewed.
+void destroy_viewer(struct VIEWER * viewer) {
+    if (viewer->header != NULL) munmap(viewer->header, viewer->size);
+}
+
+// The reference viewer: maps the ring read-only, copies the latest frame
+// into a board and writes it in the format of the output file.
+int view_frame(char * name, char * output_filename, int output_format, int codec, unsigned int tile_size) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    struct VIEWER_HEADER header;
+    if (fd < 0 || read(fd, &header, sizeof(header)) != (ssize_t) sizeof(header) || header.magic != VIEWER_MAGIC) {
+        fprintf(stderr, "Error: No viewer ring \"%s\"\n", name);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    struct VIEWER viewer;
+    viewer.name = name;
+    viewer.frame_size = (size_t) header.words * header.height * sizeof(uint64_t);
+    viewer.size = VIEWER_HEADER_SIZE + 2 * viewer.frame_size;
+    void * memory = mmap(NULL, viewer.size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map shared memory \"%s\"\n", name);
+        return -1;
+    }
+    viewer.header = (struct VIEWER_HEADER *) memory;
+
+    struct LIFE life = create_life(header.width, header.height, tile_size, NUMA_FIRST_TOUCH, 1, 0);
+    if (life.cells == NULL || life.new_cells == NULL) {
+        fprintf(stderr, "Error: Not enough memory for a %u x %u board\n", header.width, header.height);
+        destroy_life(&life);
+        munmap(memory, viewer.size);
+        return -1;
+    }
+    struct POOL * pool = create_pool(&life, 1, 0);
+    if (pool == NULL) {
+        fprintf(stderr, "Error: Cannot start the thread of the viewer\n");
+        destroy_life(&life);
+        munmap(memory, viewer.size);
+        return -1;
+    }
+    pool_touch(pool, NULL);
+
+    unsigned int generation;
+    while (1) {
+        unsigned long long sequence = atomic_load_explicit(&viewer.header->sequence, memory_order_acquire);
+        if (sequence == 0) {
+            usleep(1000);
+            continue;
+        }
+        unsigned int slot = (unsigned int) ((sequence - 1) % 2);
+        memcpy(life.cells, viewer_frame(&viewer, slot), viewer.frame_size);
+        generation = (unsigned int) viewer.header->generation[slot];
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&viewer.header->sequence, memory_order_relaxed) == sequence) break;
+    }
+    pool_run(pool, TASK_SCAN, life.tiles_x * life.tiles_y);
+
+    struct BMP bmp = create_bmp(life.width, life.height, NULL);
+    struct SNAPSHOT snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    if (output_format == FORMAT_SNAPSHOT) snapshot = create_snapshot(life.width, life.height, codec, NULL);
+    int result = save_output(&life, &bmp, &snapshot, pool, output_filename, output_format, generation);
+    if (result == 0) printf("frame of generation %u written\n", generation);
+
+    destroy_snapshot(&snapshot);
+    destroy_pool(pool);
+    destroy_life(&life);
+    munmap(memory, viewer.size);
+    return result;
+}
+
+// The fuzz target (fuzz/fuzz_bmp.c) includes this file without its main.
+#ifndef BMP_FUZZ
+int main(int argc, char *argv[]) {
+    char * input_filename = "";
+    char * output_filename = "";
+    int output_format = FORMAT_BMP;
+    int codec = default_codec();
+    int convert = 0;
+    int bench = 0;
+    char * socket_path = "";
+    char * viewer_name = "";
+    struct REGION * regions = NULL;
+    unsigned int region_count = 0;
+    unsigned int scale = 0;
+    int scale_mode = SCALE_OR;
+    char * view_name = "";
+    struct INPUT input;
+    memset(&input, 0, sizeof(input));
+    input.density = 0.5;
+    int random_soup = 0;
+    unsigned long long search_soups = 0;
+    char * regress_filename = "";
+    char * engine_name = "auto";
+    int list = 0;
+    double regress_threshold = 10;
+    int regress_timing = 1;
+    int max_iter = -1;
+    int dump_freq = 1;
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int tile_size = 64;
+    int pool_stats = 0;
+    int pin_threads = 0;
+    int pipelined = 0;
+    int numa_policy = NUMA_FIRST_TOUCH;
+    int ranks = 1;
+    int transport_kind = TRANSPORT_SHM;
+    int cycles = CYCLES_AUTO;
+    char * stats_filename = "";
+    struct STATS_OUTPUT stats_output = {NULL, STATS_CSV, 1, 0};
+
+    char has_error = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--input") == 0) {
+            input_filename = argv[++i];
+            input.format = pattern_format(input_filename);
+            if (input.format == -1) {
+                fprintf(stderr, "Error: Invalid input file name \"%s\"\n", input_filename);
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--output") == 0) {
+            output_filename = argv[++i];
+            output_format = pattern_format(output_filename);
+            if (output_format == -1) {
+                fprintf(stderr, "Error: Invalid output file name \"%s\"\n", output_filename);
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--max_iter") == 0) {
+            char * max_iter_str = argv[++i];
+            max_iter = atoi(max_iter_str);
+            if (max_iter < 1) {
+                fprintf(stderr, "Error: --max-iter parameter value must be positive\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--dump_freq") == 0) {
+            char * dump_freq_str = argv[++i];
+            dump_freq = atoi(dump_freq_str);
+            if (dump_freq < 0 || (dump_freq == 0 && strcmp(dump_freq_str, "0") != 0)) {
+                fprintf(stderr, "Error: --dump_freq parameter value must be 0 or positive\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--snapshot_codec") == 0) {
+            char * codec_str = argv[++i];
+            codec = codec_by_name(codec_str);
+            if (codec == -1) {
+                fprintf(stderr, "Error: Codec \"%s\" is not available\n", codec_str);
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--convert") == 0) {
+            convert = 1;
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--roi") == 0) {
+            char * roi_str = argv[++i];
+            struct REGION region = {0, 0, 0, 0, 0, NULL, NULL};
+            int length = 0;
+            int tail = 0;
+            int parsed = sscanf(roi_str, "%u,%u,%u,%u%n/%u%n", &region.x, &region.y, &region.width, &region.height,
+                                &length, &region.scale, &tail);
+            int whole = (parsed == 4 && roi_str[length] == '\0') || (parsed == 5 && roi_str[tail] == '\0');
+            if (!whole || region.width == 0 || region.height == 0 || (parsed == 5 && region.scale == 0)) {
+                fprintf(stderr, "Error: --roi parameter value must be <x>,<y>,<width>,<height>[/<num>]\n");
+                has_error = 1;
+            }
+            regions = (struct REGION *) realloc(regions, (region_count + 1) * sizeof(struct REGION));
+            regions[region_count++] = region;
+        } else if (strcmp(argv[i], "--scale") == 0) {
+            char * scale_str = argv[++i];
+            if (sscanf(scale_str, "1/%u", &scale) != 1 || scale == 0) {
+                fprintf(stderr, "Error: --scale parameter value must be 1/<num>\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--scale_mode") == 0) {
+            char * mode_str = argv[++i];
+            if (strcmp(mode_str, "or") == 0) {
+                scale_mode = SCALE_OR;
+            } else if (strcmp(mode_str, "density") == 0) {
+                scale_mode = SCALE_DENSITY;
+            } else {
+                fprintf(stderr, "Error: --scale_mode parameter value must be or or density\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--viewer") == 0) {
+            viewer_name = argv[++i];
+        } else if (strcmp(argv[i], "--view") == 0) {
+            view_name = argv[++i];
+        } else if (strcmp(argv[i], "--snapshot_bench") == 0) {
+            bench = 1;
+        } else if (strcmp(argv[i], "--board") == 0) {
+            char * board_str = argv[++i];
+            if (sscanf(board_str, "%ux%u", &input.width, &input.height) != 2 || input.width == 0 || input.height == 0) {
+                fprintf(stderr, "Error: --board parameter value must be <width>x<height>\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--random") == 0) {
+            char * random_str = argv[++i];
+            random_soup = 1;
+            if (sscanf(random_str, "%ux%u", &input.width, &input.height) != 2 || input.width == 0 || input.height == 0) {
+                fprintf(stderr, "Error: --random parameter value must be <width>x<height>\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--density") == 0) {
+            char * density_str = argv[++i];
+            if (sscanf(density_str, "%lf", &input.density) != 1 || !(input.density >= 0 && input.density <= 1)) {
+                fprintf(stderr, "Error: --density parameter value must be between 0 and 1\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            char * seed_str = argv[++i];
+            unsigned long long seed = 0;
+            if (sscanf(seed_str, "%llu", &seed) != 1) {
+                fprintf(stderr, "Error: --seed parameter value must be a non-negative number\n");
+                has_error = 1;
+            }
+            input.seed = (uint64_t) seed;
+        } else if (strcmp(argv[i], "--search") == 0) {
+            char * search_str = argv[++i];
+            if (sscanf(search_str, "%llu", &search_soups) != 1 || search_soups == 0) {
+                fprintf(stderr, "Error: --search parameter value must be positive\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--engine") == 0) {
+            engine_name = argv[++i];
+            if (strcmp(engine_name, "auto") != 0 && engine_by_name(engine_name) == NULL) {
+                fprintf(stderr, "Error: Engine \"%s\" is not available\n", engine_name);
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            pipelined = 1;
+        } else if (strcmp(argv[i], "--list_engines") == 0) {
+            list = 1;
+        } else if (strcmp(argv[i], "--regress") == 0) {
+            regress_filename = argv[++i];
+        } else if (strcmp(argv[i], "--regress_threshold") == 0) {
+            char * threshold_str = argv[++i];
+            if (sscanf(threshold_str, "%lf", &regress_threshold) != 1 || regress_threshold < 0) {
+                fprintf(stderr, "Error: --regress_threshold parameter value must be a non-negative percentage\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--regress_timing") == 0) {
+            char * timing_str = argv[++i];
+            if (strcmp(timing_str, "on") == 0) {
+                regress_timing = 1;
+            } else if (strcmp(timing_str, "off") == 0) {
+                regress_timing = 0;
+            } else {
+                fprintf(stderr, "Error: --regress_timing parameter value must be on or off\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--offset") == 0) {
+            char * offset_str = argv[++i];
+            if (sscanf(offset_str, "%u,%u", &input.offset_x, &input.offset_y) != 2) {
+                fprintf(stderr, "Error: --offset parameter value must be <x>,<y>\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            char * threads_str = argv[++i];
+            threads = atoi(threads_str);
+            if (threads < 1) {
+                fprintf(stderr, "Error: --threads parameter value must be positive\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--tile") == 0) {
+            char * tile_str = argv[++i];
+            tile_size = atoi(tile_str);
+            if (tile_size < 1) {
+                fprintf(stderr, "Error: --tile parameter value must be positive\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--pool_stats") == 0) {
+            pool_stats = 1;
+        } else if (strcmp(argv[i], "--ranks") == 0) {
+            char * ranks_str = argv[++i];
+            ranks = atoi(ranks_str);
+            if (ranks < 1) {
+                fprintf(stderr, "Error: --ranks parameter value must be positive\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--cycles") == 0) {
+            char * cycles_str = argv[++i];
+            if (strcmp(cycles_str, "auto") == 0) {
+                cycles = CYCLES_AUTO;
+            } else if (strcmp(cycles_str, "on") == 0) {
+                cycles = CYCLES_ON;
+            } else if (strcmp(cycles_str, "off") == 0) {
+                cycles = CYCLES_OFF;
+            } else {
+                fprintf(stderr, "Error: --cycles parameter value must be auto, on or off\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--transport") == 0) {
+            char * transport_str = argv[++i];
+            if (strcmp(transport_str, "shm") == 0) {
+                transport_kind = TRANSPORT_SHM;
+#ifdef HAVE_MPI
+            } else if (strcmp(transport_str, "mpi") == 0) {
+                transport_kind = TRANSPORT_MPI;
+#endif
+            } else {
+                fprintf(stderr, "Error: Transport \"%s\" is not available\n", transport_str);
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_filename = argv[++i];
+        } else if (strcmp(argv[i], "--stats_format") == 0) {
+            char * format_str = argv[++i];
+            if (strcmp(format_str, "csv") == 0) {
+                stats_output.format = STATS_CSV;
+            } else if (strcmp(format_str, "binary") == 0) {
+                stats_output.format = STATS_BINARY;
+            } else {
+                fprintf(stderr, "Error: --stats_format parameter value must be csv or binary\n");
+                has_error = 1;
+            }
+        } else if (strcmp(argv[i], "--stats_freq") == 0) {
+            char * stats_freq_str = argv[++i];
+            int stats_freq = atoi(stats_freq_str);
+            if (stats_freq < 1) {
+                fprintf(stderr, "Error: --stats_freq parameter value must be positive\n");
+                has_error = 1;
+            }
+            stats_output.freq = (unsigned int) stats_freq;
+        } else if (strcmp(argv[i], "--pin_threads") == 0) {
+            pin_threads = 1;
+        } else if (strcmp(argv[i], "--numa") == 0) {
+            char * numa_str = argv[++i];
+            if (strcmp(numa_str, "first_touch") == 0) {
+                numa_policy = NUMA_FIRST_TOUCH;
+            } else if (strcmp(numa_str, "interleave") == 0) {
+                numa_policy = NUMA_INTERLEAVE;
+            } else {
+                fprintf(stderr, "Error: --numa parameter value must be first_touch or interleave\n");
+                has_error = 1;
+            }
+        }
+    }
+
+    if (strcmp(socket_path, "") != 0) {
+        if (has_error) return -1;
+        struct SERVER server;
+        memset(&server, 0, sizeof(server));
+        server.threads = threads < 1 ? 1 : (unsigned int) threads;
+        server.tile_size = (unsigned int) tile_size;
+        server.pin_threads = pin_threads;
+        server.numa_policy = numa_policy;
+        server.codec = codec;
+        server.auto_select = strcmp(engine_name, "auto") == 0;
+        server.engine = server.auto_select ? NULL : engine_by_name(engine_name);
+        return run_server(socket_path, &server);
+    }
+
+    if (strcmp(view_name, "") != 0) {
+        if (strcmp(output_filename, "") == 0) {
+            fprintf(stderr, "Error: Missing required parameter --output\n");
+            has_error = 1;
+        }
+        if (has_error) return -1;
+        return view_frame(view_name, output_filename, output_format, codec, (unsigned int) tile_size);
+    }
+
+    if (list) {
+        if (has_error) return -1;
+        return list_engines(threads < 1 ? 1 : (unsigned int) threads, numa_policy);
+    }
+
+    if (strcmp(regress_filename, "") != 0) {
+        if (has_error) return -1;
+        return run_regress(regress_filename, regress_threshold, regress_timing, threads < 1 ? 1 : (unsigned int) threads, numa_policy);
+    }
+
+    if (search_soups > 0) {
+        if (!random_soup) {
+            fprintf(stderr, "Error: --search needs --random <width>x<height>\n");
+            has_error = 1;
+        }
+        if (max_iter == -1) {
+            fprintf(stderr, "Error: Missing required parameter --max_iter\n");
+            has_error = 1;
+        }
+        if (has_error) return -1;
+        input.format = FORMAT_RANDOM;
+        return run_search(&input, search_soups, (unsigned int) max_iter, threads < 1 ? 1 : (unsigned int) threads,
+                          (unsigned int) tile_size, numa_policy);
+    }
+
+    if (random_soup) {
+        if (strcmp(input_filename, "") != 0) {
+            fprintf(stderr, "Error: --input and --random cannot be used together\n");
+            has_error = 1;
+        }
+        input.format = FORMAT_RANDOM;
+    } else if (strcmp(input_filename, "") == 0) {
+        fprintf(stderr, "Error: Missing required parameter --input\n");
+        has_error = 1;
+    }
+    if (strcmp(output_filename, "") == 0 && !bench) {
+        fprintf(stderr, "Error: Missing required parameter --output\n");
+        has_error = 1;
+    }
+    if (max_iter == -1 && !convert && !bench) {
+        fprintf(stderr, "Error: Missing required parameter --max_iter\n");
+        has_error = 1;
+    }
+
+    // With MPI the number of ranks is that of mpirun.
+    int distributed = ranks > 1 || transport_kind == TRANSPORT_MPI;
+    if (ranks > 1 && transport_kind == TRANSPORT_MPI) {
+        fprintf(stderr, "Error: --ranks is not used with --transport mpi, mpirun starts the ranks\n");
+        has_error = 1;
+    }
+    if (distributed && (output_format != FORMAT_BMP || input.format == FORMAT_SNAPSHOT)) {
+        fprintf(stderr, "Error: --ranks supports only .bmp output and .bmp, pattern or random input\n");
+        has_error = 1;
+    }
+    if (distributed && pipelined) {
+        fprintf(stderr, "Error: --pipeline is not supported with --ranks\n");
+        has_error = 1;
+    }
+    if (distributed && strcmp(viewer_name, "") != 0) {
+        fprintf(stderr, "Error: --viewer is not supported with --ranks\n");
+        has_error = 1;
+    }
+    if ((region_count > 0 || scale > 0) && (output_format != FORMAT_BMP || distributed)) {
+        fprintf(stderr, "Error: --roi and --scale support only .bmp output without --ranks\n");
+        has_error = 1;
+    }
+
+    if (has_error) return -1;
+
+    input.filename = input_filename;
+    struct BMP bmp;
+    struct SNAPSHOT snapshot;
+    unsigned int generation = 0;
+    if (read_input(&input, &bmp, &snapshot, &generation, distributed) != 0) return -1;
+
+    if (distributed) {
+        int result = run_distributed(&input, output_filename, max_iter, dump_freq, transport_kind,
+                                     (unsigned int) ranks, pool_stats, &stats_output, stats_filename);
+        free(input.pattern.data);
+        return result;
+    }
+    if (open_stats(&stats_output, stats_filename, input.height) != 0) return -1;
+
+    unsigned int height = input.height;
+    unsigned int width = input.width;
+
+    if (scale > 0 && region_count == 0) {
+        struct REGION board = {0, 0, width, height, 0, NULL, NULL};
+        regions = (struct REGION *) malloc(sizeof(struct REGION));
+        regions[region_count++] = board;
+    }
+    // --scale is the scale of every region that does not give its own.
+    if (scale == 0) scale = 1;
+    for (unsigned int i = 0; i < region_count; i++) {
+        if (regions[i].scale == 0) regions[i].scale = scale;
+        if (regions[i].x + regions[i].width > width || regions[i].y + regions[i].height > height) {
+            fprintf(stderr, "Error: --roi %u,%u,%u,%u is outside the %u x %u board\n", regions[i].x, regions[i].y,
+                    regions[i].width, regions[i].height, width, height);
+            return -1;
+        }
+        regions[i].filename = region_filename(output_filename, i, region_count);
+        if (regions[i].filename == NULL) {
+            fprintf(stderr, "Error: Not enough memory for the region file names\n");
+            return -1;
+        }
+    }
+
+    if (threads < 1) threads = 1;
+    size_t extra = output_format == FORMAT_SNAPSHOT && !bench ? snapshot_bytes(width, height, codec) : 0;
+    if (cycles == CYCLES_AUTO) cycles = max_iter >= CYCLE_MIN_ITER ? CYCLES_ON : CYCLES_OFF;
+    if (bench || convert) cycles = CYCLES_OFF;
+    if (cycles == CYCLES_ON) extra += cycle_bytes(width, height);
+    if (pipelined && !bench && !convert) extra += pipeline_bytes(width, height, (unsigned int) tile_size);
+    struct LIFE life = create_life(width, height, (unsigned int) tile_size, numa_policy, stats_output.file != NULL,
+                                   extra);
+    if (life.cells == NULL || life.new_cells == NULL) {
+        fprintf(stderr, "Error: Not enough memory for a %u x %u board\n", width, height);
+        return -1;
+    }
+    struct CYCLE cycle;
+    memset(&cycle, 0, sizeof(cycle));
+    if (cycles == CYCLES_ON && create_cycle(&cycle, &life) != 0) return -1;
+    struct POOL * pool = create_pool(&life, (unsigned int) threads, pin_threads);
+    if (pool == NULL) {
+        fprintf(stderr, "Error: Cannot start %d threads\n", threads);
+        return -1;
+    }
+    if (fill_life(pool, &input, &bmp, &snapshot) != 0) return -1;
+
+    if (bench) {
+        snapshot_bench(pool, 5);
+        destroy_pool(pool);
+        destroy_life(&life);
+        return 0;
+    }
+
+    memset(&snapshot, 0, sizeof(snapshot));
+    if (output_format == FORMAT_SNAPSHOT) snapshot = create_snapshot(width, height, codec, &life.arena);
+
+    FILE * outfile = NULL;
+    if (region_count <= 1) {
+        outfile = fopen(output_filename, "wb");
+        if (outfile == NULL) {
+            fprintf(stderr, "Error: Cannot open output file \"%s\"\n", output_filename);
+            return -1;
+        }
+    }
+    for (unsigned int i = 0; i < region_count; i++) {
+        regions[i].file = regions[i].filename == output_filename ? outfile : fopen(regions[i].filename, "wb");
+        if (regions[i].file == NULL) {
+            fprintf(stderr, "Error: Cannot open output file \"%s\"\n", regions[i].filename);
+            return -1;
+        }
+    }
+
+    if (convert) {
+        int result = 0;
+        if (region_count > 0) write_regions(&life, regions, region_count, scale_mode);
+        else result = write_output(&life, &bmp, &snapshot, pool, outfile, output_format, generation);
+        close_outputs(outfile, regions, region_count);
+        destroy_pool(pool);
+        destroy_life(&life);
+        return result;
+    }
+    struct PIPELINE pipeline;
+    if (pipelined && create_pipeline(&pipeline, &life, &bmp, &snapshot, outfile, output_format, regions,
+                                     region_count, scale_mode, dump_freq) != 0) return -1;
+    print_memory_budget(&life);
+    int auto_select = strcmp(engine_name, "auto") == 0;
+    struct ENGINE * engine = auto_select ? auto_engine(&life, (unsigned int) threads) : engine_by_name(engine_name);
+    printf("engine: %s%s\n", engine->name, auto_select ? " (auto)" : "");
+
+    struct VIEWER viewer;
+    memset(&viewer, 0, sizeof(viewer));
+    if (strcmp(viewer_name, "") != 0) {
+        if (create_viewer(&viewer, viewer_name, &life) != 0) return -1;
+        publish_frame(&viewer, &life, generation);
+    }
+
+    struct STATS stats = life_stats(&life);
+    write_stats(&stats_output, generation, &stats, 0);
+    if (cycles == CYCLES_ON) find_cycle(&cycle, &life, generation, stats.hash);
+
+    int stable_flag = 1;
+    int empty_flag = 1;
+
+    for (unsigned int time = 0; time < max_iter; time++) {
+
+        if (!pipelined) sleep(dump_freq);
+        printf("time: %d ", time);
+
+        if (auto_select && time > 0 && time % ENGINE_CHECK == 0) engine = auto_engine(&life, (unsigned int) threads);
+        engine->step(pool);
+
+        stats = life_stats(&life);
+        stable_flag = stats.diff == 0;
+        empty_flag = stats.any == 0;
+        unsigned int period = stable_flag || empty_flag ? 1
+                              : cycles == CYCLES_ON ? find_cycle(&cycle, &life, generation + time + 1, stats.hash)
+                              : 0;
+
+        // A board that repeats is only run on to its phase at max_iter, and
+        // is written as generation max_iter, like at the end of a full run.
+        // A board that has just died takes one more step, so its statistics
+        // are those of an empty board, too.
+        unsigned int reported = generation + time + 1;
+        if (period > 0 && time + 1 < (unsigned int) max_iter) {
+            unsigned int steps = stable_flag ? 0 : empty_flag ? 1 : (max_iter - time - 1) % period;
+            for (unsigned int i = 0; i < steps; i++) engine->step(pool);
+            stats = life_stats(&life);
+            reported = generation + max_iter;
+        }
+        int last = period > 0 || time + 1 == max_iter;
+        write_stats(&stats_output, reported, &stats, last);
+
+        // With a viewer ring the frames go to the ring, and only the last
+        // generation is written to the output file.
+        if (viewer.header != NULL) publish_frame(&viewer, &life, reported);
+        if (viewer.header == NULL || last) {
+            if (pipelined) pipeline_push(&pipeline, &life, reported);
+            else if (region_count > 0) write_regions(&life, regions, region_count, scale_mode);
+            else if (write_output(&life, &bmp, &snapshot, pool, outfile, output_format, reported) != 0) return -1;
+        }
+        printf("written\n");
+
+        if (stable_flag == 1) {
+            printf("The Game of Life is stable");
+            break;
+        }
+        if (empty_flag == 1) {
+            printf("The Game of Life is dead");
+            break;
+        }
+        // The hash of the first repeated board came back one period before
+        // the repeat was verified, and two periods after the board itself.
+        if (period > 0) {
+            printf("The Game of Life is periodic with period %u since generation %u, jumped to generation %u",
+                   period, generation + time + 1 - 2 * period, reported);
+            break;
+        }
+    }
+
+    int result = pipelined ? finish_pipeline(&pipeline) : 0;
+    if (pool_stats) {
+        printf("\n");
+        print_pool_stats(pool);
+        if (pipelined) {
+            printf("pipeline: %llu generations written, game waited %.3f ms\n", pipeline.written,
+                   pipeline.waited * 1000);
+        }
+    }
+    close_outputs(outfile, regions, region_count);
+    destroy_viewer(&viewer);
+    destroy_snapshot(&snapshot);
+    destroy_pool(pool);
+    destroy_life(&life);
+    if (stats_output.file != NULL) fclose(stats_output.file);
+    return result;
+}
+#endif